@@ -1,17 +1,42 @@
 #include "ArgParser.hpp"
+#include "Bytecode.hpp"
+#include "BytecodeFile.hpp"
+#include "CFFI.hpp"
 #include "CodeGenerator.hpp"
+#include "ControlFlowGraph.hpp"
 #include "ErrorHandler.hpp"
 #include "Lexer.hpp"
+#include "Optimizer.hpp"
 #include "Parser.hpp"
-#include "StaticAddressPass.hpp"
+#include "Program.hpp"
 #include "VM.hpp"
 
 #include <cassert>
 #include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <print>
 #include <string>
 
+// Runs a .junec file without going through the frontend
+static int run_compiled(const jl::ArgParser::Params& params)
+{
+    jl::BytecodeFile file(params.file_name);
+
+    if (!file.is_valid()) {
+        return 1;
+    }
+
+    const auto root_id = file.root_id();
+    const jl::Program program(file.take_code(), root_id, file.data());
+    jl::VM vm(program);
+    const auto [res, vars] = params.step_by_step
+        ? vm.interactive_execute()
+        : vm.run();
+
+    return res == jl::VM::OK ? 0 : 1;
+}
+
 int main(int argc, char const* argv[])
 {
 
@@ -22,7 +47,15 @@ int main(int argc, char const* argv[])
         return 0;
     }
 
-    std::string file_name { argv[1] };
+    for (const auto& path : params->library_paths) {
+        jl::CFFI::instance().add_search_path(path);
+    }
+
+    if (params->run_compiled) {
+        return run_compiled(*params);
+    }
+
+    std::string file_name { params->file_name };
     jl::Lexer lexer(file_name);
 
     lexer.scan();
@@ -46,16 +79,35 @@ int main(int argc, char const* argv[])
         return 1;
     }
 
+    jl::optimize(chunk_map, jl::OptimizerOptions {
+        .inline_functions = params->inline_functions,
+        .fold_constants = params->fold_constants,
+    });
+
     if (params->debug) {
         std::println("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~DISASSEMBLY~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
         codegen.disassemble();
+        std::println("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~CONTROL-FLOW-GRAPH~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
+        for (const auto& [name, chunk] : chunk_map) {
+            if (!chunk.extern_symbol) {
+                jl::print_dot(std::cout, chunk, jl::build_cfg(chunk));
+            }
+        }
         std::println("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~PROGRAM-OUTPUT~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~");
     }
 
-    jl::patch_memmory_address(chunk_map, (uint64_t)data_section.data());
+    if (params->compile) {
+        const auto function_ids = jl::assign_function_ids(chunk_map);
+        const auto code = jl::lower_all(chunk_map, function_ids);
+        const auto output = std::filesystem::path(file_name).replace_extension(".junec");
+
+        return jl::write_bytecode_file(output, code, function_ids.at("__root__"), data_section) ? 0 : 1;
+    }
+
     auto chunk = codegen.get_root_chunk();
 
-    jl::VM vm(chunk_map, (jl::ptr_type)data_section.data());
+    const jl::Program program(chunk_map, data_section);
+    jl::VM vm(program);
     const auto [res, vars] = params->step_by_step
         ? vm.interactive_execute()
         : vm.run();
@@ -68,8 +120,8 @@ int main(int argc, char const* argv[])
             std::println("{}\t{}", name, jl::VM::pretty_print(vars[temp], type));
         }
 
-        data_section.disassemble(std::cout);
+        jl::DataSection::disassemble(std::cout, vm.data());
     }
 
-    return 0;
+    return res == jl::VM::OK ? 0 : 1;
 }
\ No newline at end of file
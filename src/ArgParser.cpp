@@ -19,6 +19,11 @@ void jl::ArgParser::print_help()
     std::println("-h\t--help\t\tTo print this help");
     std::println("-s\t--step-by-step\tTo run in step-by-step mode");
     std::println("-d\t--debug\t\tTo print the disassemby and other data");
+    std::println("\t--no-fold\tTo skip constant folding");
+    std::println("\t--no-inline\tTo skip inlining of small functions");
+    std::println("\t--compile\tTo write the bytecode to a .junec file without running it");
+    std::println("\t--run\t\tTo run a .junec file");
+    std::println("\t--lib-path=dir\tTo search dir for the libraries of externs, can be repeated");
 }
 
 std::optional<jl::ArgParser::Params> jl::ArgParser::parse()
@@ -31,6 +36,7 @@ std::optional<jl::ArgParser::Params> jl::ArgParser::parse()
 
     std::optional<std::string> file_path;
     std::unordered_set<Options> options;
+    std::vector<std::pair<Options, std::string>> values;
     bool incorrect_use = false;
 
     for (int i = 1; i < m_args; i++) {
@@ -42,8 +48,13 @@ std::optional<jl::ArgParser::Params> jl::ArgParser::parse()
         if (arg[0] == '-') {
             if (arg[1] == '-') {
                 // std::println("long {}", &arg[2]);
-                if (m_long_flags.contains(&arg[2])) {
-                    options.insert(m_long_flags.at(&arg[2]));
+                const std::string flag = &arg[2];
+                const auto equals = flag.find('=');
+
+                if (m_long_flags.contains(flag)) {
+                    options.insert(m_long_flags.at(flag));
+                } else if (equals != std::string::npos && m_value_flags.contains(flag.substr(0, equals))) {
+                    values.push_back({ m_value_flags.at(flag.substr(0, equals)), flag.substr(equals + 1) });
                 } else {
                     incorrect_use = true;
                     std::println("Unknown argument {}", &arg[2]);
@@ -90,6 +101,26 @@ std::optional<jl::ArgParser::Params> jl::ArgParser::parse()
         case STEP_BY_STEP:
             params.step_by_step = true;
             break;
+        case NO_CONSTANT_FOLDING:
+            params.fold_constants = false;
+            break;
+        case NO_INLINING:
+            params.inline_functions = false;
+            break;
+        case COMPILE:
+            params.compile = true;
+            break;
+        case RUN_COMPILED:
+            params.run_compiled = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    for (const auto& [opt, value] : values) {
+        if (opt == LIBRARY_PATH) {
+            params.library_paths.push_back(value);
         }
     }
 
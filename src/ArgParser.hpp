@@ -3,6 +3,7 @@
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace jl {
 
@@ -14,6 +15,14 @@ public:
         std::string file_name;
         bool step_by_step {false};
         bool debug {false};
+        bool fold_constants {true};
+        bool inline_functions {true};
+        // Write the bytecode to a .junec file instead of running it
+        bool compile {false};
+        // The file is a .junec file to run without compiling
+        bool run_compiled {false};
+        // Directories searched for the libraries externs name
+        std::vector<std::string> library_paths;
     };
 
     std::optional<Params> parse();
@@ -23,6 +32,11 @@ private:
         HELP,
         IR_DEBUG,
         STEP_BY_STEP,
+        NO_CONSTANT_FOLDING,
+        NO_INLINING,
+        COMPILE,
+        RUN_COMPILED,
+        LIBRARY_PATH,
     };
 
     std::unordered_map<char, Options> m_short_flags {
@@ -34,9 +48,18 @@ private:
     std::unordered_map<std::string, Options> m_long_flags {
         { "step-by-step", STEP_BY_STEP },
         { "debug", IR_DEBUG },
+        { "no-fold", NO_CONSTANT_FOLDING },
+        { "no-inline", NO_INLINING },
+        { "compile", COMPILE },
+        { "run", RUN_COMPILED },
         { "help", HELP },
     };
 
+    // Long flags taking a value, given as --flag=value
+    std::unordered_map<std::string, Options> m_value_flags {
+        { "lib-path", LIBRARY_PATH },
+    };
+
     int m_args;
     char const** m_argv;
 
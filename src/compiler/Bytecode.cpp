@@ -0,0 +1,559 @@
+#include "Bytecode.hpp"
+
+#include "Ir.hpp"
+#include "OpCode.hpp"
+#include "Operand.hpp"
+#include "Superinstructions.hpp"
+#include "Utils.hpp"
+
+#include <cstring>
+#include <span>
+
+template <typename T>
+static jl::reg_type store_in_reg(const T& data)
+{
+    jl::reg_type reg = 0;
+    std::memcpy(&reg, &data, sizeof(T));
+    return reg;
+}
+
+static jl::reg_type extract_data(const jl::Operand& op)
+{
+    switch (jl::get_type(op)) {
+    case jl::OperandType::TEMP:
+    case jl::OperandType::UNASSIGNED:
+        unimplemented();
+    case jl::OperandType::NIL:
+        return 0;
+    case jl::OperandType::INT:
+        return store_in_reg(std::get<jl::int_type>(op));
+    case jl::OperandType::FLOAT:
+        return store_in_reg(std::get<jl::float_type>(op));
+    case jl::OperandType::BOOL:
+        return store_in_reg(std::get<bool>(op));
+    case jl::OperandType::CHAR:
+        return store_in_reg(std::get<char>(op));
+    case jl::OperandType::CHAR_PTR:
+    case jl::OperandType::INT_PTR:
+    case jl::OperandType::FLOAT_PTR:
+    case jl::OperandType::BOOL_PTR:
+    case jl::OperandType::NIL_PTR:
+        return store_in_reg(std::get<jl::PtrVar>(op).offset);
+    }
+    unimplemented();
+    return 0;
+}
+
+const char* jl::to_string(Op op)
+{
+    switch (op) {
+#define JL_OP_NAME(NAME) \
+    case Op::NAME:       \
+        return #NAME;
+        JL_BYTECODE_OPS(JL_OP_NAME)
+#undef JL_OP_NAME
+    }
+
+    unimplemented();
+    return "UNKNOWN";
+}
+
+static uint32_t add_constant(jl::BytecodeChunk& bc, const jl::Operand& operand)
+{
+    bc.constants.push_back(extract_data(operand));
+    return bc.constants.size() - 1;
+}
+
+static jl::Op select_int_op(jl::OpCode opcode)
+{
+    using jl::Op;
+    using jl::OpCode;
+
+    switch (opcode) {
+    case OpCode::ADD:
+        return Op::ADD_INT;
+    case OpCode::MINUS:
+        return Op::SUB_INT;
+    case OpCode::STAR:
+        return Op::MUL_INT;
+    case OpCode::SLASH:
+        return Op::DIV_INT;
+    case OpCode::MODULUS:
+        return Op::MOD_INT;
+    case OpCode::LESS:
+        return Op::LESS_INT;
+    case OpCode::LESS_EQUAL:
+        return Op::LESS_EQUAL_INT;
+    case OpCode::GREATER:
+        return Op::GREATER_INT;
+    case OpCode::GREATER_EQUAL:
+        return Op::GREATER_EQUAL_INT;
+    case OpCode::EQUAL:
+        return Op::EQUAL_INT;
+    case OpCode::NOT_EQUAL:
+        return Op::NOT_EQUAL_INT;
+    case OpCode::BIT_AND:
+        return Op::BIT_AND_INT;
+    case OpCode::BIT_OR:
+        return Op::BIT_OR_INT;
+    case OpCode::BIT_XOR:
+        return Op::BIT_XOR_INT;
+    default:
+        unimplemented("No int variant for opcode");
+    }
+
+    return Op::HALT;
+}
+
+static jl::Op select_float_op(jl::OpCode opcode)
+{
+    using jl::Op;
+    using jl::OpCode;
+
+    switch (opcode) {
+    case OpCode::ADD:
+        return Op::ADD_FLOAT;
+    case OpCode::MINUS:
+        return Op::SUB_FLOAT;
+    case OpCode::STAR:
+        return Op::MUL_FLOAT;
+    case OpCode::SLASH:
+        return Op::DIV_FLOAT;
+    case OpCode::LESS:
+        return Op::LESS_FLOAT;
+    case OpCode::LESS_EQUAL:
+        return Op::LESS_EQUAL_FLOAT;
+    case OpCode::GREATER:
+        return Op::GREATER_FLOAT;
+    case OpCode::GREATER_EQUAL:
+        return Op::GREATER_EQUAL_FLOAT;
+    case OpCode::EQUAL:
+        return Op::EQUAL_FLOAT;
+    case OpCode::NOT_EQUAL:
+        return Op::NOT_EQUAL_FLOAT;
+    default:
+        unimplemented("No float variant for opcode");
+    }
+
+    return Op::HALT;
+}
+
+static jl::Op select_char_op(jl::OpCode opcode)
+{
+    using jl::Op;
+    using jl::OpCode;
+
+    switch (opcode) {
+    case OpCode::LESS:
+        return Op::LESS_CHAR;
+    case OpCode::LESS_EQUAL:
+        return Op::LESS_EQUAL_CHAR;
+    case OpCode::GREATER:
+        return Op::GREATER_CHAR;
+    case OpCode::GREATER_EQUAL:
+        return Op::GREATER_EQUAL_CHAR;
+    case OpCode::EQUAL:
+        return Op::EQUAL_CHAR;
+    case OpCode::NOT_EQUAL:
+        return Op::NOT_EQUAL_CHAR;
+    default:
+        unimplemented("No char variant for opcode");
+    }
+
+    return Op::HALT;
+}
+
+static jl::Op select_bool_op(jl::OpCode opcode)
+{
+    using jl::Op;
+    using jl::OpCode;
+
+    switch (opcode) {
+    case OpCode::AND:
+        return Op::AND_BOOL;
+    case OpCode::OR:
+        return Op::OR_BOOL;
+    case OpCode::LESS:
+        return Op::LESS_BOOL;
+    case OpCode::LESS_EQUAL:
+        return Op::LESS_EQUAL_BOOL;
+    case OpCode::GREATER:
+        return Op::GREATER_BOOL;
+    case OpCode::GREATER_EQUAL:
+        return Op::GREATER_EQUAL_BOOL;
+    case OpCode::EQUAL:
+        return Op::EQUAL_BOOL;
+    case OpCode::NOT_EQUAL:
+        return Op::NOT_EQUAL_BOOL;
+    default:
+        unimplemented("No bool variant for opcode");
+    }
+
+    return Op::HALT;
+}
+
+// Pointer offsets are scaled by the size of the element pointed to
+static jl::Op select_ptr_op(jl::OpCode opcode, jl::OperandType type)
+{
+    using jl::Op;
+    using jl::OpCode;
+
+    const auto select_offset_op = [&](Op op_8, Op op_32, Op op_64) {
+        const auto ele_type = jl::from_ptr(type);
+        if (!ele_type) {
+            unimplemented("Offsetting a pointer without an element type");
+        }
+
+        switch (jl::size_of_type(*ele_type)) {
+        case 1:
+            return op_8;
+        case 4:
+            return op_32;
+        case 8:
+            return op_64;
+        default:
+            unimplemented("Unsupported element size");
+        }
+
+        return Op::HALT;
+    };
+
+    switch (opcode) {
+    case OpCode::ADD:
+        return select_offset_op(Op::ADD_PTR_8, Op::ADD_PTR_32, Op::ADD_PTR_64);
+    case OpCode::MINUS:
+        return select_offset_op(Op::SUB_PTR_8, Op::SUB_PTR_32, Op::SUB_PTR_64);
+    case OpCode::LESS:
+        return Op::LESS_PTR;
+    case OpCode::LESS_EQUAL:
+        return Op::LESS_EQUAL_PTR;
+    case OpCode::GREATER:
+        return Op::GREATER_PTR;
+    case OpCode::GREATER_EQUAL:
+        return Op::GREATER_EQUAL_PTR;
+    case OpCode::EQUAL:
+        return Op::EQUAL_PTR;
+    case OpCode::NOT_EQUAL:
+        return Op::NOT_EQUAL_PTR;
+    default:
+        unimplemented("No pointer variant for opcode");
+    }
+
+    return Op::HALT;
+}
+
+static jl::Op select_binary_op(jl::OpCode opcode, jl::OperandType type)
+{
+    switch (type) {
+    case jl::OperandType::INT:
+        return select_int_op(opcode);
+    case jl::OperandType::FLOAT:
+        return select_float_op(opcode);
+    case jl::OperandType::CHAR:
+        return select_char_op(opcode);
+    case jl::OperandType::BOOL:
+        return select_bool_op(opcode);
+    case jl::OperandType::CHAR_PTR:
+    case jl::OperandType::INT_PTR:
+    case jl::OperandType::FLOAT_PTR:
+    case jl::OperandType::BOOL_PTR:
+    case jl::OperandType::NIL_PTR:
+        return select_ptr_op(opcode, type);
+    case jl::OperandType::NIL:
+        // nil is always zero, so it compares like a null pointer
+        return select_ptr_op(opcode, type);
+    default:
+        unimplemented("Binary operation on an untyped operand");
+    }
+
+    return jl::Op::HALT;
+}
+
+static jl::Op select_load_store_op(jl::OpCode opcode, uint32_t size)
+{
+    const bool is_load = opcode == jl::OpCode::LOAD;
+
+    switch (size) {
+    case 1:
+        return is_load ? jl::Op::LOAD_8 : jl::Op::STORE_8;
+    case 4:
+        return is_load ? jl::Op::LOAD_32 : jl::Op::STORE_32;
+    case 8:
+        return is_load ? jl::Op::LOAD_64 : jl::Op::STORE_64;
+    default:
+        unimplemented("Unsupported load/store size");
+    }
+
+    return jl::Op::HALT;
+}
+
+// Casts between pointers and casts to the same type do not change the value
+static jl::Op select_cast_op(jl::OperandType from, jl::OperandType to)
+{
+    using jl::Op;
+    using jl::OperandType;
+
+    if (from == to || (jl::is_pure_ptr(from) && jl::is_pure_ptr(to))) {
+        return Op::MOVE;
+    }
+
+    if (from == OperandType::INT && to == OperandType::FLOAT) {
+        return Op::INT_TO_FLOAT;
+    } else if (from == OperandType::FLOAT && to == OperandType::INT) {
+        return Op::FLOAT_TO_INT;
+    } else if (from == OperandType::INT && to == OperandType::CHAR) {
+        return Op::INT_TO_CHAR;
+    } else if (from == OperandType::CHAR && to == OperandType::INT) {
+        return Op::CHAR_TO_INT;
+    } else if (from == OperandType::FLOAT && to == OperandType::CHAR) {
+        return Op::FLOAT_TO_CHAR;
+    } else if (from == OperandType::CHAR && to == OperandType::FLOAT) {
+        return Op::CHAR_TO_FLOAT;
+    }
+
+    unimplemented("Unsupported type cast");
+    return Op::HALT;
+}
+
+static jl::Instruction lower_ir(
+    jl::BytecodeChunk& bc,
+    const jl::Chunk& chunk,
+    const jl::FunctionIds& function_ids,
+    const jl::Ir& ir)
+{
+    using namespace jl;
+
+    Instruction ins {
+        .op = Op::HALT,
+        .a = 0,
+        .b = 0,
+        .c = 0,
+    };
+
+    switch (ir.type()) {
+    case Ir::BINARY: {
+        const auto& bin = ir.binary();
+        ins.op = select_binary_op(bin.opcode, bin.type);
+        ins.a = bin.dest.idx;
+        ins.b = bin.op1.idx;
+        ins.c = bin.op2.idx;
+    } break;
+    case Ir::UNARY: {
+        const auto& un = ir.unary();
+        ins.a = un.dest.idx;
+
+        if (get_type(un.operand) != OperandType::TEMP) {
+            // Constant operands are evaluated right away
+            auto value = extract_data(un.operand);
+            const bool is_data = is_pure_ptr(get_type(un.operand));
+            switch (un.opcode) {
+            case OpCode::MOVE:
+                break;
+            case OpCode::NOT:
+                // An address in the data section is never null
+                value = is_data ? 0 : !value;
+                break;
+            case OpCode::BIT_NOT:
+                value = ~value;
+                break;
+            default:
+                unimplemented("Unsupported unary opcode");
+            }
+
+            bc.constants.push_back(value);
+            ins.op = is_data && un.opcode == OpCode::MOVE ? Op::MOVE_DATA : Op::MOVE_CONST;
+            ins.b = bc.constants.size() - 1;
+            break;
+        }
+
+        switch (un.opcode) {
+        case OpCode::MOVE:
+            ins.op = Op::MOVE;
+            break;
+        case OpCode::NOT:
+            ins.op = Op::NOT;
+            break;
+        case OpCode::BIT_NOT:
+            ins.op = Op::BIT_NOT;
+            break;
+        default:
+            // Codegen converts negation to a multiplication
+            unimplemented("Unsupported unary opcode");
+        }
+        ins.b = std::get<TempVar>(un.operand).idx;
+    } break;
+    case Ir::CONTROL: {
+        const auto& ctrl = ir.control();
+        switch (ctrl.opcode) {
+        case OpCode::JMP:
+            ins.op = Op::JMP;
+            ins.a = std::get<int>(ctrl.data);
+            break;
+        case OpCode::RETURN:
+            if (get_type(ctrl.data) == OperandType::TEMP) {
+                ins.op = Op::RETURN;
+                ins.b = std::get<TempVar>(ctrl.data).idx;
+            } else {
+                ins.op = is_pure_ptr(get_type(ctrl.data)) ? Op::RETURN_DATA : Op::RETURN_CONST;
+                ins.b = add_constant(bc, ctrl.data);
+            }
+            break;
+        case OpCode::HALT:
+            ins.op = Op::HALT;
+            break;
+        default:
+            unimplemented();
+        }
+    } break;
+    case Ir::JUMP_STORE: {
+        const auto& jmp = ir.jump();
+        ins.op = Op::JMP_UNLESS;
+        ins.a = std::get<int>(jmp.target);
+        ins.b = jmp.data.idx;
+    } break;
+    case Ir::CALL: {
+        const auto& call = ir.call();
+        ins.op = Op::CALL;
+        ins.a = call.return_var.idx;
+        ins.b = bc.call_sites.size();
+
+        // The count of a map is not passed to the extern
+        auto args = std::span(call.args);
+        if (call.opcode == OpCode::MAP) {
+            ins.op = Op::MAP_EXTERN;
+            ins.a = 0;
+            ins.c = args.front().idx;
+            args = args.subspan(1);
+        }
+
+        bc.call_sites.push_back(CallSite {
+            .func_id = function_ids.at(call.func_name),
+            .args_offset = static_cast<uint32_t>(bc.call_args.size()),
+            .arg_count = static_cast<uint32_t>(args.size()),
+        });
+
+        for (const auto& arg : args) {
+            bc.call_args.push_back(arg.idx);
+            bc.call_arg_types.push_back(chunk.get_nested_type(arg));
+        }
+    } break;
+    case Ir::TYPE_CAST: {
+        const auto& cast = ir.cast();
+        ins.op = select_cast_op(cast.from, cast.to);
+        ins.a = cast.dest.idx;
+        ins.b = cast.source.idx;
+    } break;
+    case Ir::LOAD_STORE: {
+        const auto& ls = ir.load_store();
+        ins.op = select_load_store_op(ls.opcode, ls.size);
+        ins.a = ls.reg.idx;
+        ins.b = ls.addr.idx;
+    } break;
+    default:
+        unimplemented();
+    }
+
+    return ins;
+}
+
+// Rewrites the label of every jump with the offset of the instruction
+// following that label
+static void link(jl::BytecodeChunk& bc, const std::vector<uint32_t>& labels)
+{
+    for (auto& ins : bc.code) {
+        if (ins.op == jl::Op::JMP || ins.op == jl::Op::JMP_UNLESS) {
+            ins.a = labels[ins.a];
+        }
+    }
+}
+
+jl::FunctionIds jl::assign_function_ids(const std::map<std::string, Chunk>& chunk_map)
+{
+    FunctionIds function_ids;
+    uint32_t id = 0;
+
+    for (const auto& [name, chunk] : chunk_map) {
+        function_ids[name] = id++;
+    }
+
+    return function_ids;
+}
+
+jl::BytecodeChunk jl::lower(const Chunk& chunk, const FunctionIds& function_ids)
+{
+    BytecodeChunk bc;
+    const auto& irs = chunk.get_ir();
+    std::vector<uint32_t> labels(chunk.get_max_labels());
+
+    bc.code.reserve(irs.size() + 1);
+    bc.origins.reserve(irs.size() + 1);
+    bc.frame_size = chunk.get_max_allocated_temps();
+    if (bc.frame_size > max_frame_size) {
+        std::println("COMPILE ERROR: : {} needs more than {} registers", chunk.m_name, max_frame_size);
+        std::exit(1);
+    }
+    bc.return_type = chunk.return_type;
+    bc.extern_symbol = chunk.extern_symbol;
+    bc.extern_library = chunk.extern_library;
+    bc.is_variadic = chunk.is_variadic;
+    bc.source = &chunk;
+
+    // The c signature of an extern, the optimizer never touches these chunks
+    if (chunk.extern_symbol) {
+        for (const auto& name : chunk.get_input_variable_names()) {
+            bc.param_types.push_back(chunk.get_nested_type(*chunk.look_up_variable(name)));
+        }
+    }
+
+    bool label_at_end = false;
+
+    for (uint32_t i = 0; i < irs.size(); i++) {
+        if (irs[i].type() == Ir::CONTROL && irs[i].control().opcode == OpCode::LABEL) {
+            labels[std::get<int>(irs[i].control().data)] = bc.code.size();
+            label_at_end = true;
+            continue;
+        }
+
+        bc.code.push_back(lower_ir(bc, chunk, function_ids, irs[i]));
+        bc.origins.push_back(i);
+        label_at_end = false;
+    }
+
+    // The dispatch loop does not check for the end of code, so make
+    // sure that every june function ends with a return
+    const bool has_return = !bc.code.empty()
+        && (bc.code.back().op == Op::RETURN || bc.code.back().op == Op::RETURN_CONST || bc.code.back().op == Op::RETURN_DATA);
+
+    if (!chunk.extern_symbol && (!has_return || label_at_end)) {
+        bc.code.push_back(Instruction {
+            .op = Op::RETURN_CONST,
+            .a = 0,
+            .b = add_constant(bc, Nil {}),
+            .c = 0,
+        });
+        bc.origins.push_back(irs.empty() ? 0 : irs.size() - 1);
+    }
+
+    link(bc, labels);
+    fuse_superinstructions(bc);
+
+    const auto lines = chunk.get_lines();
+    bc.lines.reserve(bc.origins.size());
+    for (const auto origin : bc.origins) {
+        bc.lines.push_back(origin < lines.size() ? lines[origin] : 0);
+    }
+
+    return bc;
+}
+
+std::vector<jl::BytecodeChunk> jl::lower_all(const std::map<std::string, Chunk>& chunk_map, const FunctionIds& function_ids)
+{
+    std::vector<BytecodeChunk> code;
+    code.reserve(chunk_map.size());
+
+    for (const auto& [name, chunk] : chunk_map) {
+        code.push_back(lower(chunk, function_ids));
+    }
+
+    return code;
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CFFI.hpp"
+#include "Chunk.hpp"
+#include "OpCode.hpp"
+#include "Operand.hpp"
+#include "Utils.hpp"
+
+namespace jl {
+
+// Every instruction the VM can execute, fully specialized on the type
+// of its operands. The order here decides the order of the dispatch table.
+#define JL_BYTECODE_OPS(X)                \
+    X(ADD_INT)                            \
+    X(SUB_INT)                            \
+    X(MUL_INT)                            \
+    X(DIV_INT)                            \
+    X(MOD_INT)                            \
+    X(LESS_INT)                           \
+    X(LESS_EQUAL_INT)                     \
+    X(GREATER_INT)                        \
+    X(GREATER_EQUAL_INT)                  \
+    X(EQUAL_INT)                          \
+    X(NOT_EQUAL_INT)                      \
+    X(BIT_AND_INT)                        \
+    X(BIT_OR_INT)                         \
+    X(BIT_XOR_INT)                        \
+    X(ADD_FLOAT)                          \
+    X(SUB_FLOAT)                          \
+    X(MUL_FLOAT)                          \
+    X(DIV_FLOAT)                          \
+    X(LESS_FLOAT)                         \
+    X(LESS_EQUAL_FLOAT)                   \
+    X(GREATER_FLOAT)                      \
+    X(GREATER_EQUAL_FLOAT)                \
+    X(EQUAL_FLOAT)                        \
+    X(NOT_EQUAL_FLOAT)                    \
+    X(LESS_CHAR)                          \
+    X(LESS_EQUAL_CHAR)                    \
+    X(GREATER_CHAR)                       \
+    X(GREATER_EQUAL_CHAR)                 \
+    X(EQUAL_CHAR)                         \
+    X(NOT_EQUAL_CHAR)                     \
+    X(AND_BOOL)                           \
+    X(OR_BOOL)                            \
+    X(LESS_BOOL)                          \
+    X(LESS_EQUAL_BOOL)                    \
+    X(GREATER_BOOL)                       \
+    X(GREATER_EQUAL_BOOL)                 \
+    X(EQUAL_BOOL)                         \
+    X(NOT_EQUAL_BOOL)                     \
+    X(ADD_PTR_8)                          \
+    X(ADD_PTR_32)                         \
+    X(ADD_PTR_64)                         \
+    X(SUB_PTR_8)                          \
+    X(SUB_PTR_32)                         \
+    X(SUB_PTR_64)                         \
+    X(LESS_PTR)                           \
+    X(LESS_EQUAL_PTR)                     \
+    X(GREATER_PTR)                        \
+    X(GREATER_EQUAL_PTR)                  \
+    X(EQUAL_PTR)                          \
+    X(NOT_EQUAL_PTR)                      \
+    X(MOVE)                               \
+    X(MOVE_CONST)                         \
+    X(MOVE_DATA)                          \
+    X(NOT)                                \
+    X(BIT_NOT)                            \
+    X(JMP)                                \
+    X(JMP_UNLESS)                         \
+    X(RETURN)                             \
+    X(RETURN_CONST)                       \
+    X(RETURN_DATA)                        \
+    X(CALL)                               \
+    X(MAP_EXTERN)                         \
+    X(INT_TO_FLOAT)                       \
+    X(FLOAT_TO_INT)                       \
+    X(INT_TO_CHAR)                        \
+    X(CHAR_TO_INT)                        \
+    X(FLOAT_TO_CHAR)                      \
+    X(CHAR_TO_FLOAT)                      \
+    X(LOAD_8)                             \
+    X(LOAD_32)                            \
+    X(LOAD_64)                            \
+    X(STORE_8)                            \
+    X(STORE_32)                           \
+    X(STORE_64)                           \
+    X(JMP_UNLESS_LESS_INT)                \
+    X(JMP_UNLESS_LESS_EQUAL_INT)          \
+    X(JMP_UNLESS_GREATER_INT)             \
+    X(JMP_UNLESS_GREATER_EQUAL_INT)       \
+    X(JMP_UNLESS_EQUAL_INT)               \
+    X(JMP_UNLESS_NOT_EQUAL_INT)           \
+    X(JMP_UNLESS_LESS_INT_CONST)          \
+    X(JMP_UNLESS_LESS_EQUAL_INT_CONST)    \
+    X(JMP_UNLESS_GREATER_INT_CONST)       \
+    X(JMP_UNLESS_GREATER_EQUAL_INT_CONST) \
+    X(JMP_UNLESS_EQUAL_INT_CONST)         \
+    X(JMP_UNLESS_NOT_EQUAL_INT_CONST)     \
+    X(ADD_INT_CONST)                      \
+    X(SUB_INT_CONST)                      \
+    X(LOAD_INDEXED_8)                     \
+    X(LOAD_INDEXED_32)                    \
+    X(LOAD_INDEXED_64)                    \
+    X(STORE_INDEXED_8)                    \
+    X(STORE_INDEXED_32)                   \
+    X(STORE_INDEXED_64)                   \
+    X(HALT)
+
+enum class Op : uint8_t {
+#define JL_OP_ENUM(NAME) NAME,
+    JL_BYTECODE_OPS(JL_OP_ENUM)
+#undef JL_OP_ENUM
+};
+
+const char* to_string(Op op);
+
+// Fixed width instruction executed by the VM
+//
+//  *_INT/_FLOAT/...    a: dest     b: op1      c: op2
+//  ADD_PTR_*/SUB_PTR_* a: dest     b: ptr      c: int offset scaled by the element size
+//  MOVE/NOT/BIT_NOT    a: dest     b: reg
+//  MOVE_CONST          a: dest     b: index into constants
+//  MOVE_DATA           a: dest     b: index into constants holding an offset into the data section
+//  JMP                 a: target
+//  JMP_UNLESS          a: target   b: condition
+//  RETURN              b: reg
+//  RETURN_CONST        b: index into constants
+//  RETURN_DATA         b: index into constants holding an offset into the data section
+//  CALL                a: dest     b: index into call_sites
+//  MAP_EXTERN                      b: index into call_sites  c: element count
+//  *_TO_*              a: dest     b: source
+//  LOAD_*/STORE_*      a: reg      b: addr
+//
+// Superinstructions fused from common sequences by fuse_superinstructions
+//
+//  JMP_UNLESS_*_INT    a: target   b: op1      c: op2
+//  JMP_UNLESS_*_CONST  a: target   b: op1      c: index into constants
+//  ADD/SUB_INT_CONST   a: dest     b: op1      c: index into constants
+//  LOAD_INDEXED_*      a: reg      b: ptr      c: int index
+//  STORE_INDEXED_*     a: reg      b: ptr      c: int index
+//
+// MAP_EXTERN calls an extern once for every element. Its call site passes
+// the destination array first if the extern returns a value, then every
+// parameter either as an array of the parameter type, read one element per
+// call, or as a value passed to every call.
+//
+// Jump targets are absolute offsets into the code of the chunk. Labels are
+// resolved while lowering and do not exist in the bytecode.
+//
+// Pointers into the data section are kept as offsets and only become
+// addresses when *_DATA adds the base address of the VM running them, so
+// bytecode does not depend on where the data section is placed.
+struct Instruction {
+    Op op;
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+};
+
+static_assert(sizeof(Instruction) == 16);
+
+// Largest frame of a function. Registers are addressed by 32 bit operands,
+// but every call allocates the whole frame of the callee.
+static constexpr uint32_t max_frame_size = 1 << 16;
+
+struct CallSite {
+    uint32_t func_id;
+    uint32_t args_offset;
+    uint32_t arg_count;
+};
+
+struct BytecodeChunk {
+    std::vector<Instruction> code;
+    std::vector<reg_type> constants;
+    std::vector<CallSite> call_sites;
+    // Registers of call arguments, indexed by CallSite::args_offset
+    std::vector<uint32_t> call_args;
+    // Type of every call argument, calls to variadic externs are prepared
+    // for the types they pass
+    std::vector<OperandType> call_arg_types;
+    // Index of the Ir each instruction was lowered from
+    std::vector<uint32_t> origins;
+    // Source line of every instruction
+    std::vector<uint32_t> lines;
+    uint32_t frame_size { 0 };
+    OperandType return_type { OperandType::UNASSIGNED };
+    std::vector<OperandType> param_types;
+    std::optional<std::string> extern_symbol;
+    std::optional<std::string> extern_library;
+    // Extern taking any number of arguments after param_types
+    bool is_variadic { false };
+    // Only set when lowered from a chunk in this process
+    const Chunk* source { nullptr };
+    // The c function of an extern chunk which is not variadic, owned by
+    // the program
+    const CFFI::Function* extern_func { nullptr };
+    // Indexed by call site, the c function prepared for each call to a
+    // variadic extern, owned by the program. Empty if there are none.
+    std::vector<const CFFI::Function*> variadic_calls;
+};
+
+// Functions are called by their index in the chunk map instead of by name
+using FunctionIds = std::unordered_map<std::string, uint32_t>;
+
+FunctionIds assign_function_ids(const std::map<std::string, Chunk>& chunk_map);
+
+BytecodeChunk lower(const Chunk& chunk, const FunctionIds& function_ids);
+
+// Lowers every chunk, the result is indexed by function id
+std::vector<BytecodeChunk> lower_all(const std::map<std::string, Chunk>& chunk_map, const FunctionIds& function_ids);
+
+}
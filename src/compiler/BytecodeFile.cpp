@@ -0,0 +1,583 @@
+#include "BytecodeFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
+#include <print>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunk_count;
+    uint32_t root_id;
+    uint32_t reserved;
+    uint64_t data_offset;
+    uint64_t data_size;
+};
+
+constexpr char file_magic[8] = { 'J', 'U', 'N', 'E', 'C', '\0', '\0', '\0' };
+// Length written in place of a missing optional string
+constexpr uint32_t no_string = UINT32_MAX;
+constexpr size_t data_alignment = 16;
+
+static_assert(sizeof(Header) == jl::bytecode_header_size);
+// Instructions are written without the padding of the struct
+static_assert(jl::bytecode_instruction_size == sizeof(jl::Op) + 3 * sizeof(uint32_t));
+// Missing symbol and library, return type, parameter count, is_variadic and
+// frame size, then the code, constant, call site and call argument counts
+static_assert(jl::bytecode_code_size_offset
+    == 2 * sizeof(no_string) + sizeof(jl::OperandType) + sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t));
+static_assert(jl::bytecode_code_offset == jl::bytecode_code_size_offset + 4 * sizeof(uint32_t));
+
+class Writer {
+public:
+    template <typename T>
+    void write(const T& value)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(&value);
+        m_buffer.insert(m_buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    void write_array(const std::vector<T>& values)
+    {
+        const auto* bytes = reinterpret_cast<const uint8_t*>(values.data());
+        m_buffer.insert(m_buffer.end(), bytes, bytes + values.size() * sizeof(T));
+    }
+
+    // Field by field, so the padding of the struct never reaches the file
+    void write_code(const std::vector<jl::Instruction>& code)
+    {
+        for (const auto& ins : code) {
+            write(ins.op);
+            write(ins.a);
+            write(ins.b);
+            write(ins.c);
+        }
+    }
+
+    void write_bytes(const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+    }
+
+    void write_string(const std::optional<std::string>& value)
+    {
+        if (value) {
+            write(static_cast<uint32_t>(value->size()));
+            write_bytes(value->data(), value->size());
+        } else {
+            write(no_string);
+        }
+    }
+
+    void align(size_t alignment)
+    {
+        m_buffer.resize((m_buffer.size() + alignment - 1) / alignment * alignment, 0);
+    }
+
+    size_t size() const { return m_buffer.size(); }
+    std::vector<uint8_t>& buffer() { return m_buffer; }
+
+private:
+    std::vector<uint8_t> m_buffer;
+};
+
+// Reads values out of the mapped file, failing instead of reading past its end
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size)
+        : m_data(data)
+        , m_size(size)
+    {
+    }
+
+    template <typename T>
+    bool read(T& value)
+    {
+        if (m_size - m_offset < sizeof(T)) {
+            return false;
+        }
+
+        std::memcpy(&value, m_data + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return true;
+    }
+
+    template <typename T>
+    bool read_array(std::vector<T>& values, size_t count)
+    {
+        if ((m_size - m_offset) / sizeof(T) < count) {
+            return false;
+        }
+
+        values.resize(count);
+        std::memcpy(values.data(), m_data + m_offset, count * sizeof(T));
+        m_offset += count * sizeof(T);
+        return true;
+    }
+
+    bool read_code(std::vector<jl::Instruction>& code, size_t count)
+    {
+        if ((m_size - m_offset) / jl::bytecode_instruction_size < count) {
+            return false;
+        }
+
+        code.resize(count);
+        for (auto& ins : code) {
+            read(ins.op);
+            read(ins.a);
+            read(ins.b);
+            read(ins.c);
+        }
+        return true;
+    }
+
+    bool read_string(std::optional<std::string>& value)
+    {
+        uint32_t length;
+        if (!read(length)) {
+            return false;
+        }
+        if (length == no_string) {
+            value.reset();
+            return true;
+        }
+        if (m_size - m_offset < length) {
+            return false;
+        }
+
+        value.emplace(reinterpret_cast<const char*>(m_data + m_offset), length);
+        m_offset += length;
+        return true;
+    }
+
+    size_t offset() const { return m_offset; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_offset { 0 };
+};
+
+// NIL_PTR is the last OperandType
+constexpr uint32_t type_count = static_cast<uint32_t>(jl::OperandType::NIL_PTR) + 1;
+
+bool is_known_type(jl::OperandType type)
+{
+    return static_cast<uint32_t>(type) < type_count;
+}
+
+// Types a c function can take or return, which CFFI has a c type for
+bool is_c_type(jl::OperandType type)
+{
+    return is_known_type(type) && type != jl::OperandType::TEMP && type != jl::OperandType::UNASSIGNED;
+}
+
+constexpr uint32_t op_count = 0
+#define JL_OP_COUNT(NAME) +1
+    JL_BYTECODE_OPS(JL_OP_COUNT)
+#undef JL_OP_COUNT
+    ;
+
+// Checks every field an instruction uses against the arrays it indexes,
+// since the VM trusts them without checking. Returns an error message on
+// failure.
+const char* validate_code(const jl::BytecodeChunk& bc, uint64_t data_size)
+{
+    using jl::Op;
+
+    const auto reg = [&](uint32_t r) { return r < bc.frame_size; };
+    const auto target = [&](uint32_t t) { return t < bc.code.size(); };
+    const auto constant = [&](uint32_t c) { return c < bc.constants.size(); };
+    // A pointer may point one past the end of the data section
+    const auto data = [&](uint32_t c) { return constant(c) && bc.constants[c] <= data_size; };
+    const auto site = [&](uint32_t s) { return s < bc.call_sites.size(); };
+
+    for (const auto& ins : bc.code) {
+        if (static_cast<uint32_t>(ins.op) >= op_count) {
+            return "invalid opcode";
+        }
+
+        bool valid;
+        switch (ins.op) {
+        case Op::MOVE:
+        case Op::NOT:
+        case Op::BIT_NOT:
+        case Op::INT_TO_FLOAT:
+        case Op::FLOAT_TO_INT:
+        case Op::INT_TO_CHAR:
+        case Op::CHAR_TO_INT:
+        case Op::FLOAT_TO_CHAR:
+        case Op::CHAR_TO_FLOAT:
+        case Op::LOAD_8:
+        case Op::LOAD_32:
+        case Op::LOAD_64:
+        case Op::STORE_8:
+        case Op::STORE_32:
+        case Op::STORE_64:
+            valid = reg(ins.a) && reg(ins.b);
+            break;
+        case Op::MOVE_CONST:
+            valid = reg(ins.a) && constant(ins.b);
+            break;
+        case Op::MOVE_DATA:
+            valid = reg(ins.a) && data(ins.b);
+            break;
+        case Op::JMP:
+            valid = target(ins.a);
+            break;
+        case Op::JMP_UNLESS:
+            valid = target(ins.a) && reg(ins.b);
+            break;
+        case Op::RETURN:
+            valid = reg(ins.b);
+            break;
+        case Op::RETURN_CONST:
+            valid = constant(ins.b);
+            break;
+        case Op::RETURN_DATA:
+            valid = data(ins.b);
+            break;
+        case Op::CALL:
+            valid = reg(ins.a) && site(ins.b);
+            break;
+        case Op::MAP_EXTERN:
+            valid = site(ins.b) && reg(ins.c);
+            break;
+        case Op::JMP_UNLESS_LESS_INT:
+        case Op::JMP_UNLESS_LESS_EQUAL_INT:
+        case Op::JMP_UNLESS_GREATER_INT:
+        case Op::JMP_UNLESS_GREATER_EQUAL_INT:
+        case Op::JMP_UNLESS_EQUAL_INT:
+        case Op::JMP_UNLESS_NOT_EQUAL_INT:
+            valid = target(ins.a) && reg(ins.b) && reg(ins.c);
+            break;
+        case Op::JMP_UNLESS_LESS_INT_CONST:
+        case Op::JMP_UNLESS_LESS_EQUAL_INT_CONST:
+        case Op::JMP_UNLESS_GREATER_INT_CONST:
+        case Op::JMP_UNLESS_GREATER_EQUAL_INT_CONST:
+        case Op::JMP_UNLESS_EQUAL_INT_CONST:
+        case Op::JMP_UNLESS_NOT_EQUAL_INT_CONST:
+            valid = target(ins.a) && reg(ins.b) && constant(ins.c);
+            break;
+        case Op::ADD_INT_CONST:
+        case Op::SUB_INT_CONST:
+            valid = reg(ins.a) && reg(ins.b) && constant(ins.c);
+            break;
+        case Op::HALT:
+            valid = true;
+            break;
+        default:
+            // Binary ops, pointer arithmetic and indexed loads and stores
+            valid = reg(ins.a) && reg(ins.b) && reg(ins.c);
+            break;
+        }
+
+        if (!valid) {
+            return "invalid instruction";
+        }
+    }
+
+    for (const auto arg : bc.call_args) {
+        if (!reg(arg)) {
+            return "invalid call";
+        }
+    }
+
+    if (bc.extern_symbol) {
+        return bc.code.empty() ? nullptr : "extern function with code";
+    }
+
+    // The dispatch loop does not check for the end of code
+    if (bc.code.empty()) {
+        return "function without code";
+    }
+
+    switch (bc.code.back().op) {
+    case Op::JMP:
+    case Op::RETURN:
+    case Op::RETURN_CONST:
+    case Op::RETURN_DATA:
+    case Op::HALT:
+        return nullptr;
+    default:
+        return "function runs past its code";
+    }
+}
+
+}
+
+bool jl::write_bytecode_file(
+    const std::string& file_name,
+    const std::vector<BytecodeChunk>& code,
+    uint32_t root_id,
+    const DataSection& data_section)
+{
+    Writer writer;
+    Header header {};
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = bytecode_file_version;
+    header.chunk_count = code.size();
+    header.root_id = root_id;
+    writer.write(header);
+
+    for (const auto& bc : code) {
+        writer.write_string(bc.extern_symbol);
+        writer.write_string(bc.extern_library);
+        writer.write(bc.return_type);
+        writer.write(static_cast<uint32_t>(bc.param_types.size()));
+        writer.write_array(bc.param_types);
+        writer.write(static_cast<uint8_t>(bc.is_variadic));
+        writer.write(bc.frame_size);
+        writer.write(static_cast<uint32_t>(bc.code.size()));
+        writer.write(static_cast<uint32_t>(bc.constants.size()));
+        writer.write(static_cast<uint32_t>(bc.call_sites.size()));
+        writer.write(static_cast<uint32_t>(bc.call_args.size()));
+
+        writer.write_code(bc.code);
+        writer.write_array(bc.constants);
+        writer.write_array(bc.call_sites);
+        writer.write_array(bc.call_args);
+        writer.write_array(bc.call_arg_types);
+        writer.write_array(bc.lines);
+    }
+
+    writer.align(data_alignment);
+    const auto data_offset = writer.size();
+    writer.write_bytes(data_section.data(), data_section.size());
+
+    // The header is only complete once the position of the data is known
+    auto& buffer = writer.buffer();
+    header.data_offset = data_offset;
+    header.data_size = data_section.size();
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+    if (!file.good()) {
+        std::println("Unable to write {}", file_name);
+        return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    return file.good();
+}
+
+jl::BytecodeFile::BytecodeFile(const std::string& file_name)
+{
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::println("Unable to open {}", file_name);
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        std::println("Unable to read {}", file_name);
+        close(fd);
+        return;
+    }
+
+    m_size = info.st_size;
+    m_mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (m_mapping == MAP_FAILED) {
+        m_mapping = nullptr;
+        std::println("Unable to map {}", file_name);
+        return;
+    }
+
+    if (const auto error = parse()) {
+        std::println("Invalid bytecode file {}: {}", file_name, error);
+        return;
+    }
+
+    m_valid = true;
+}
+
+jl::BytecodeFile::~BytecodeFile()
+{
+    if (m_mapping != nullptr) {
+        munmap(m_mapping, m_size);
+    }
+}
+
+const char* jl::BytecodeFile::parse()
+{
+    Reader reader(static_cast<const uint8_t*>(m_mapping), m_size);
+    Header header;
+
+    if (!reader.read(header) || std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) {
+        return "not a june bytecode file";
+    }
+    if (header.version != bytecode_file_version) {
+        return "compiled by another version of june";
+    }
+    if (header.root_id >= header.chunk_count) {
+        return "missing root function";
+    }
+
+    m_code.resize(header.chunk_count);
+
+    for (auto& bc : m_code) {
+        uint32_t param_count;
+        uint32_t code_size;
+        uint32_t constant_count;
+        uint32_t call_site_count;
+        uint32_t call_arg_count;
+        uint8_t is_variadic;
+
+        if (!reader.read_string(bc.extern_symbol) || !reader.read_string(bc.extern_library)) {
+            return "truncated extern symbol";
+        }
+
+        const bool has_sizes = reader.read(bc.return_type)
+            && reader.read(param_count)
+            && reader.read_array(bc.param_types, param_count)
+            && reader.read(is_variadic)
+            && reader.read(bc.frame_size)
+            && reader.read(code_size)
+            && reader.read(constant_count)
+            && reader.read(call_site_count)
+            && reader.read(call_arg_count);
+
+        const bool has_arrays = has_sizes
+            && reader.read_code(bc.code, code_size)
+            && reader.read_array(bc.constants, constant_count)
+            && reader.read_array(bc.call_sites, call_site_count)
+            && reader.read_array(bc.call_args, call_arg_count)
+            && reader.read_array(bc.call_arg_types, call_arg_count)
+            && reader.read_array(bc.lines, code_size);
+
+        if (!has_arrays) {
+            return "truncated chunk";
+        }
+
+        bc.is_variadic = is_variadic != 0;
+        if (bc.is_variadic && !bc.extern_symbol) {
+            return "invalid variadic function";
+        }
+
+        // The VM allocates the whole frame on every call
+        if (bc.frame_size > max_frame_size) {
+            return "frame too large";
+        }
+
+        // Externs are prepared from their types, so they must all have a c
+        // type, and only the return type can be nothing
+        const bool has_valid_types = bc.extern_symbol
+            ? is_c_type(bc.return_type) && std::ranges::all_of(bc.param_types, [](const auto type) {
+                  return is_c_type(type) && type != OperandType::NIL;
+              })
+            : is_known_type(bc.return_type) && std::ranges::all_of(bc.param_types, is_known_type);
+
+        if (!has_valid_types || !std::ranges::all_of(bc.call_arg_types, is_known_type)) {
+            return "invalid type";
+        }
+
+        // Indices which would make the VM read out of bounds
+        for (const auto& site : bc.call_sites) {
+            if (site.func_id >= header.chunk_count || uint64_t { site.args_offset } + site.arg_count > call_arg_count) {
+                return "invalid call";
+            }
+        }
+
+        if (const auto error = validate_code(bc, header.data_size)) {
+            return error;
+        }
+    }
+
+    if (m_code[header.root_id].extern_symbol) {
+        return "missing root function";
+    }
+
+    // Extern calls pass exactly the parameters of the c signature, and
+    // variadic ones may pass more. Maps pass the destination array first.
+    for (const auto& bc : m_code) {
+        std::vector<bool> is_map(bc.call_sites.size(), false);
+        for (const auto& ins : bc.code) {
+            if (ins.op == Op::MAP_EXTERN) {
+                if (ins.b >= bc.call_sites.size()) {
+                    return "invalid call";
+                }
+                is_map[ins.b] = true;
+            }
+        }
+
+        for (uint32_t i = 0; i < bc.call_sites.size(); i++) {
+            const auto& site = bc.call_sites[i];
+            const auto& callee = m_code[site.func_id];
+            const auto param_count = callee.param_types.size();
+
+            // Variadic calls are prepared for the types of their arguments
+            const auto arg_types = std::span(bc.call_arg_types).subspan(site.args_offset, site.arg_count);
+            const bool has_c_types = std::ranges::all_of(arg_types, [](const auto type) {
+                return is_c_type(type) && type != OperandType::NIL;
+            });
+
+            if (callee.extern_symbol && !has_c_types) {
+                return "invalid type";
+            }
+
+            if (is_map[i]) {
+                const bool has_dest = callee.return_type != OperandType::NIL;
+                if (!callee.extern_symbol || callee.is_variadic || site.arg_count != param_count + has_dest) {
+                    return "invalid extern map";
+                }
+                continue;
+            }
+            const bool arity_matches = callee.is_variadic
+                ? site.arg_count >= param_count
+                : site.arg_count == param_count;
+
+            if (callee.extern_symbol && !arity_matches) {
+                return "invalid extern call";
+            }
+            // Arguments are copied into the frame of the callee after the
+            // function itself
+            if (!callee.extern_symbol && site.arg_count != 0 && site.arg_count >= callee.frame_size) {
+                return "invalid call";
+            }
+        }
+    }
+
+    if (header.data_offset < reader.offset() || header.data_offset % data_alignment != 0
+        || header.data_offset > m_size || m_size - header.data_offset < header.data_size) {
+        return "invalid data section";
+    }
+
+    m_root_id = header.root_id;
+    m_data_offset = header.data_offset;
+    m_data_size = header.data_size;
+
+    return nullptr;
+}
+
+bool jl::BytecodeFile::is_valid() const
+{
+    return m_valid;
+}
+
+std::vector<jl::BytecodeChunk> jl::BytecodeFile::take_code()
+{
+    return std::move(m_code);
+}
+
+uint32_t jl::BytecodeFile::root_id() const
+{
+    return m_root_id;
+}
+
+std::span<const uint8_t> jl::BytecodeFile::data() const
+{
+    return { static_cast<const uint8_t*>(m_mapping) + m_data_offset, m_data_size };
+}
\ No newline at end of file
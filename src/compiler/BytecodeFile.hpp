@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "DataSection.hpp"
+
+namespace jl {
+
+// Layout of a .junec file, every value is in the byte order of the host
+//
+//  header  magic, version, chunk count, root function id and the offset
+//          and size of the data section
+//  chunks  for every function id its extern symbol and library, return
+//          and parameter types, whether it is variadic, frame size and
+//          the arrays of its bytecode
+//  data    initial contents of the data section, aligned to 16 bytes
+//
+// The version changes whenever the layout or the bytecode ops change.
+static constexpr uint32_t bytecode_file_version = 6;
+
+// Sizes of the fixed parts of the layout
+static constexpr size_t bytecode_header_size = 40;
+static constexpr size_t bytecode_instruction_size = 13;
+// Offsets from the start of a chunk without extern symbol, library or
+// parameters, like every june function, to its code size and its code
+static constexpr size_t bytecode_code_size_offset = 18;
+static constexpr size_t bytecode_code_offset = bytecode_code_size_offset + 16;
+
+bool write_bytecode_file(
+    const std::string& file_name,
+    const std::vector<BytecodeChunk>& code,
+    uint32_t root_id,
+    const DataSection& data_section);
+
+// A .junec file mapped into memory
+class BytecodeFile {
+public:
+    explicit BytecodeFile(const std::string& file_name);
+    ~BytecodeFile();
+
+    BytecodeFile(const BytecodeFile&) = delete;
+    BytecodeFile(BytecodeFile&&) = delete;
+    BytecodeFile& operator=(const BytecodeFile&) = delete;
+    BytecodeFile& operator=(BytecodeFile&&) = delete;
+
+    // False if the file could not be loaded, the error is already reported
+    bool is_valid() const;
+
+    // Moves the bytecode out of the file, so it can only be taken once
+    std::vector<BytecodeChunk> take_code();
+    uint32_t root_id() const;
+    // Initial contents of the data section, read from the mapping
+    std::span<const uint8_t> data() const;
+
+private:
+    void* m_mapping { nullptr };
+    size_t m_size { 0 };
+    std::vector<BytecodeChunk> m_code;
+    uint32_t m_root_id { 0 };
+    size_t m_data_offset { 0 };
+    size_t m_data_size { 0 };
+    bool m_valid { false };
+
+    // Reads the header and the chunks, returns an error message on failure
+    const char* parse();
+};
+
+}
\ No newline at end of file
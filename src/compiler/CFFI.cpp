@@ -1,65 +1,250 @@
 #include "CFFI.hpp"
 
 #include <cstdlib>
+#include <cstring>
 #include <dlfcn.h>
 #include <ffi-x86_64.h>
 #include <ffi.h>
 #include <print>
+#include <type_traits>
+#include <utility>
 
-jl::CFFI::CFFI(const std::string& lib_path)
-    : m_lib_path(lib_path)
+namespace {
+
+constexpr size_t max_trampoline_args = 4;
+
+// The c type a june function returns, which is only void when it returns
+// nothing. Arguments are passed as PrimitiveType, where every pointer is a
+// ptr_type, so CHAR_PTR stands for all of them.
+template <jl::OperandType Type>
+struct ReturnType : jl::PrimitiveType<Type> { };
+
+template <>
+struct ReturnType<jl::OperandType::NIL> {
+    using type = void;
+};
+
+template <typename T>
+T from_reg(void* arg)
+{
+    T value;
+    std::memcpy(&value, arg, sizeof(T));
+    return value;
+}
+
+// Widens the value the same way libffi does, so both paths agree
+template <typename T>
+jl::reg_type to_reg(T value)
+{
+    if constexpr (std::is_integral_v<T>) {
+        return static_cast<jl::reg_type>(static_cast<int64_t>(value));
+    } else {
+        jl::reg_type reg = 0;
+        std::memcpy(&reg, &value, sizeof(T));
+        return reg;
+    }
+}
+
+template <jl::OperandType Return, jl::OperandType... Args>
+jl::reg_type trampoline(void* func, void** args)
+{
+    using Ret = typename ReturnType<Return>::type;
+    const auto c_func = reinterpret_cast<Ret (*)(typename jl::PrimitiveType<Args>::type...)>(func);
+
+    return [&]<size_t... I>(std::index_sequence<I...>) -> jl::reg_type {
+        if constexpr (std::is_void_v<Ret>) {
+            c_func(from_reg<typename jl::PrimitiveType<Args>::type>(args[I])...);
+            return 0;
+        } else {
+            return to_reg(c_func(from_reg<typename jl::PrimitiveType<Args>::type>(args[I])...));
+        }
+    }(std::make_index_sequence<sizeof...(Args)> {});
+}
+
+// Builds the argument list one type at a time, expects every type to be
+// INT or CHAR_PTR and at most max_trampoline_args of them
+template <jl::OperandType Return, jl::OperandType... Args>
+jl::CFFI::Trampoline select_trampoline(const std::vector<jl::OperandType>& arg_types)
+{
+    constexpr size_t i = sizeof...(Args);
+
+    if (i == arg_types.size()) {
+        return &trampoline<Return, Args...>;
+    }
+
+    if constexpr (i < max_trampoline_args) {
+        if (arg_types[i] == jl::OperandType::INT) {
+            return select_trampoline<Return, Args..., jl::OperandType::INT>(arg_types);
+        } else {
+            return select_trampoline<Return, Args..., jl::OperandType::CHAR_PTR>(arg_types);
+        }
+    }
+
+    return nullptr;
+}
+
+}
+
+jl::CFFI& jl::CFFI::instance()
+{
+    static CFFI cffi;
+    return cffi;
+}
+
+void jl::CFFI::add_search_path(const std::string& path)
+{
+    std::lock_guard lock(m_mutex);
+    m_search_paths.push_back(path);
+}
+
+void* jl::CFFI::open_library(const std::string& library)
+{
+    if (const auto it = m_libraries.find(library); it != m_libraries.end()) {
+        return it->second;
+    }
+
+    void* handle = nullptr;
+
+    // A name with a slash is already a path and is not searched for
+    if (library.find('/') == std::string::npos) {
+        for (const auto& dir : m_search_paths) {
+            handle = dlopen((dir + "/" + library).c_str(), RTLD_LAZY);
+            if (handle != nullptr) {
+                break;
+            }
+        }
+    }
+
+    if (handle == nullptr) {
+        handle = dlopen(library.c_str(), RTLD_LAZY);
+    }
+
+    if (handle == nullptr) {
+        std::println("RUNTIME ERROR: : Unable to open {}", library);
+        std::exit(1);
+    }
+
+    m_libraries[library] = handle;
+    return handle;
+}
+
+void* jl::CFFI::resolve(const std::string& func_name, const std::optional<std::string>& library)
 {
-    m_handle = dlopen(m_lib_path.c_str(), RTLD_LAZY);
+    std::lock_guard lock(m_mutex);
+
+    const auto& lib_name = library ? *library : std::string(default_library);
+    auto& func_ptr = m_symbols[{ lib_name, func_name }];
 
-    if (m_handle == nullptr) {
-        std::println("RUNTIME ERROR: : Unable to open {}", lib_path);
+    if (func_ptr == nullptr) {
+        func_ptr = dlsym(open_library(lib_name), func_name.c_str());
+    }
+
+    if (func_ptr == nullptr) {
+        std::println("RUNTIME ERROR: : Unable to find symbol {} in {}", func_name, lib_name);
         std::exit(1);
     }
+
+    return func_ptr;
 }
 
-jl::CFFI::~CFFI()
+jl::CFFI::Function jl::CFFI::prepare(
+    const std::string& func_name,
+    const std::optional<std::string>& library,
+    const std::vector<OperandType>& arg_types,
+    OperandType return_type)
 {
-    if (m_handle != nullptr) {
-        dlclose(m_handle);
+    Function func;
+    func.ptr = resolve(func_name, library);
+
+    for (const auto type : arg_types) {
+        func.arg_types.push_back(m_june_to_c_types.at(type));
     }
+
+    ffi_type* c_return_type = m_june_to_c_types.at(return_type);
+    unsigned int num_args = arg_types.size();
+
+    if (ffi_prep_cif(&func.cif, FFI_DEFAULT_ABI, num_args, c_return_type, func.arg_types.data()) != FFI_OK) {
+        std::println("RUNTIME ERROR: : Unable to prepare FFI for {}", func_name);
+        std::exit(1);
+    }
+
+    func.trampoline = find_trampoline(arg_types, return_type);
+
+    return func;
 }
 
-jl::reg_type jl::CFFI::call(
+jl::CFFI::Function jl::CFFI::prepare_variadic(
     const std::string& func_name,
-    const std::vector<std::pair<reg_type, OperandType>>& args,
+    const std::optional<std::string>& library,
+    const std::vector<OperandType>& arg_types,
+    size_t fixed_arg_count,
     OperandType return_type)
 {
-    // Load function symbol
-    void* func_ptr = dlsym(m_handle, func_name.c_str());
-    if (func_ptr == nullptr) {
-        std::println("RUNTIME ERROR: : Unable to find symbol {} in {}", func_name, m_lib_path);
+    Function func;
+    func.ptr = resolve(func_name, library);
+
+    for (size_t i = 0; i < arg_types.size(); i++) {
+        // Variable arguments smaller than an int are passed as one
+        const auto type = arg_types[i];
+        const bool promoted = i >= fixed_arg_count && (type == OperandType::CHAR || type == OperandType::BOOL);
+        func.arg_types.push_back(promoted ? &ffi_type_sint : m_june_to_c_types.at(type));
+    }
+
+    ffi_type* c_return_type = m_june_to_c_types.at(return_type);
+    unsigned int num_args = arg_types.size();
+
+    if (ffi_prep_cif_var(&func.cif, FFI_DEFAULT_ABI, fixed_arg_count, num_args, c_return_type, func.arg_types.data()) != FFI_OK) {
+        std::println("RUNTIME ERROR: : Unable to prepare FFI for {}", func_name);
         std::exit(1);
     }
 
-    // Prepare the cffi
-    ffi_cif cif;
-    std::vector<void*> arg_values;
+    // Trampolines call through a prototype, which a variadic function
+    // does not have
+    return func;
+}
+
+jl::CFFI::Trampoline jl::CFFI::find_trampoline(const std::vector<OperandType>& arg_types, OperandType return_type)
+{
+    if (arg_types.size() == 1 && arg_types[0] == OperandType::FLOAT && return_type == OperandType::FLOAT) {
+        return &trampoline<OperandType::FLOAT, OperandType::FLOAT>;
+    }
+
+    if (arg_types.size() > max_trampoline_args) {
+        return nullptr;
+    }
 
-    std::vector<ffi_type*> arg_types;
-    for (auto& [arg, type] : args) {
-        arg_values.push_back((void*)&(arg));
-        auto& c_type = m_june_to_c_types.at(type);
-        arg_types.push_back(&c_type);
+    std::vector<OperandType> args;
+    for (const auto type : arg_types) {
+        if (type == OperandType::INT) {
+            args.push_back(OperandType::INT);
+        } else if (is_pure_ptr(type)) {
+            args.push_back(OperandType::CHAR_PTR);
+        } else {
+            return nullptr;
+        }
     }
 
+    if (return_type == OperandType::INT) {
+        return select_trampoline<OperandType::INT>(args);
+    } else if (is_pure_ptr(return_type)) {
+        return select_trampoline<OperandType::CHAR_PTR>(args);
+    } else if (return_type == OperandType::NIL) {
+        return select_trampoline<OperandType::NIL>(args);
+    }
 
-    ffi_type* c_return_type = &m_june_to_c_types.at(return_type);
-    unsigned int num_args = args.size();
+    return nullptr;
+}
 
-    if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, num_args, c_return_type, arg_types.data()) != FFI_OK) {
-        std::println("RUNTIME ERROR: : Unable to prepare FFI for symbol {} in {}", func_name, m_lib_path);
-        std::exit(1);
+jl::reg_type jl::CFFI::call(const Function& func, void** args)
+{
+    if (func.trampoline != nullptr) {
+        return func.trampoline(func.ptr, args);
     }
 
-    reg_type ret_val;
+    reg_type ret_val = 0;
 
     // Call the c function
-    ffi_call(&cif, (void (*)())(func_ptr), &ret_val, arg_values.data());
+    ffi_call(const_cast<ffi_cif*>(&func.cif), (void (*)())(func.ptr), &ret_val, args);
 
     return ret_val;
 }
@@ -1,43 +1,106 @@
 #pragma once
 
 #include <ffi.h>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "Operand.hpp"
 #include "Utils.hpp"
 
 namespace jl {
+
+// Registry of the shared libraries externs are bound to. There is one per
+// process, every library is opened once and stays open, and every symbol
+// is looked up once. It is safe to use from several threads.
 class CFFI {
 public:
-    CFFI(const std::string& lib_path);
-    ~CFFI();
+    // Calls the function directly through a pointer of its exact type
+    using Trampoline = reg_type (*)(void* func, void** args);
+
+    // A c function with its call interface prepared for one signature
+    struct Function {
+        void* ptr { nullptr };
+        ffi_cif cif;
+        // Pointed to by the cif, moving the vector keeps its buffer
+        std::vector<ffi_type*> arg_types;
+        // Set for the common signatures, the others go through libffi
+        Trampoline trampoline { nullptr };
+
+        Function() = default;
+        Function(Function&&) = default;
+        Function& operator=(Function&&) = default;
+        Function(const Function&) = delete;
+        Function& operator=(const Function&) = delete;
+    };
+
+    // Externs which do not name a library are looked up here
+    static constexpr const char* default_library = "libc.so.6";
+
+    static CFFI& instance();
 
     CFFI(const CFFI& cffi) = delete;
     CFFI(CFFI&& cffi) = delete;
     CFFI& operator=(const CFFI& cffi) = delete;
     CFFI& operator=(CFFI&& cffi) = delete;
 
-    jl::reg_type call(
+    // Directories searched, in the order they were added, for libraries
+    // named without a path. The system search path is tried last.
+    void add_search_path(const std::string& path);
+
+    // Looks up the address of a function in the library
+    void* resolve(const std::string& func_name, const std::optional<std::string>& library);
+
+    // Looks up the function and prepares the call interface for its
+    // signature, so calls do not have to
+    Function prepare(
         const std::string& func_name,
-        const std::vector<std::pair<reg_type, OperandType>>& args,
+        const std::optional<std::string>& library,
+        const std::vector<OperandType>& arg_types,
         OperandType return_type);
 
+    // Prepares a call to a variadic function, passing the fixed parameters
+    // followed by arguments of the remaining types
+    Function prepare_variadic(
+        const std::string& func_name,
+        const std::optional<std::string>& library,
+        const std::vector<OperandType>& arg_types,
+        size_t fixed_arg_count,
+        OperandType return_type);
+
+    // Every argument points to a value widened to a register
+    static reg_type call(const Function& func, void** args);
+
+    // The trampoline for a signature, if it is common enough to have one
+    static Trampoline find_trampoline(const std::vector<OperandType>& arg_types, OperandType return_type);
+
 private:
-    std::string m_lib_path;
-    void* m_handle { nullptr };
-    std::unordered_map<OperandType, ffi_type> m_june_to_c_types {
-        { OperandType::INT, ffi_type_sint },
-        { OperandType::CHAR, ffi_type_schar },
-        { OperandType::BOOL, ffi_type_uint8 },
-        { OperandType::FLOAT, sizeof(float_type) == 4 ? ffi_type_float : ffi_type_double },
-        { OperandType::INT_PTR, ffi_type_pointer },
-        { OperandType::CHAR_PTR, ffi_type_pointer },
-        { OperandType::BOOL_PTR, ffi_type_pointer },
-        { OperandType::FLOAT_PTR, ffi_type_pointer },
-        { OperandType::NIL_PTR, ffi_type_pointer },
-        { OperandType::NIL, ffi_type_void },
+    CFFI() = default;
+
+    std::mutex m_mutex;
+    std::vector<std::string> m_search_paths;
+    // Handles by the name the library was asked for
+    std::unordered_map<std::string, void*> m_libraries;
+    // Addresses by library and symbol name
+    std::map<std::pair<std::string, std::string>, void*> m_symbols;
+    std::unordered_map<OperandType, ffi_type*> m_june_to_c_types {
+        { OperandType::INT, &ffi_type_sint },
+        { OperandType::CHAR, &ffi_type_schar },
+        { OperandType::BOOL, &ffi_type_uint8 },
+        { OperandType::FLOAT, sizeof(float_type) == 4 ? &ffi_type_float : &ffi_type_double },
+        { OperandType::INT_PTR, &ffi_type_pointer },
+        { OperandType::CHAR_PTR, &ffi_type_pointer },
+        { OperandType::BOOL_PTR, &ffi_type_pointer },
+        { OperandType::FLOAT_PTR, &ffi_type_pointer },
+        { OperandType::NIL_PTR, &ffi_type_pointer },
+        { OperandType::NIL, &ffi_type_void },
     };
+
+    // Expects the mutex to be held
+    void* open_library(const std::string& library);
 };
 }
\ No newline at end of file
@@ -30,6 +30,32 @@ std::vector<jl::Ir>& jl::Chunk::get_ir_mut()
     return m_ir;
 }
 
+void jl::Chunk::remove_ir(const std::vector<bool>& removed)
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < m_ir.size(); i++) {
+        if (removed[i]) {
+            continue;
+        }
+
+        if (kept != i) {
+            m_ir[kept] = std::move(m_ir[i]);
+            m_lines[kept] = m_lines[i];
+        }
+        kept++;
+    }
+
+    m_ir.erase(m_ir.begin() + kept, m_ir.end());
+    m_lines.erase(m_lines.begin() + kept, m_lines.end());
+}
+
+void jl::Chunk::insert_ir(uint32_t position, const std::vector<Ir>& irs, const std::vector<uint32_t>& lines)
+{
+    m_ir.insert(m_ir.begin() + position, irs.begin(), irs.end());
+    m_lines.insert(m_lines.begin() + position, lines.begin(), lines.end());
+}
+
 uint32_t jl::Chunk::get_max_allocated_temps() const
 {
     return m_var_manager.get_max_allocated_temps();
@@ -172,6 +198,42 @@ jl::OperandType jl::Chunk::handle_binary_type_inference(jl::Operand op1, jl::Ope
     return *inferred_type;
 }
 
+// Makes both operands of a binary operation have the same type, except for
+// pointer arithmetic where the pointer is moved to the left and the offset is
+// an int. Returns the type the operation has to be performed on.
+jl::OperandType jl::Chunk::prepare_binary_operands(TempVar& op1, TempVar& op2, OpCode opcode, uint32_t line)
+{
+    auto t1 = get_nested_type(op1);
+    auto t2 = get_nested_type(op2);
+
+    if (t1 == OperandType::FLOAT && t2 == OperandType::INT) {
+        // typecast t2 to float
+        op2 = write_type_cast(op2, OperandType::INT, OperandType::FLOAT, line);
+        t2 = OperandType::FLOAT;
+    } else if (t2 == OperandType::FLOAT && t1 == OperandType::INT) {
+        // typecast t1 to float
+        op1 = write_type_cast(op1, OperandType::INT, OperandType::FLOAT, line);
+        t1 = OperandType::FLOAT;
+    }
+
+    if (get_category(opcode) == OperatorCategory::ARITHAMETIC && (is_pure_ptr(t1) || is_pure_ptr(t2))) {
+        if (opcode == OpCode::ADD && t1 == OperandType::INT) {
+            std::swap(op1, op2);
+            std::swap(t1, t2);
+        }
+
+        if (t2 != OperandType::INT || (opcode != OpCode::ADD && opcode != OpCode::MINUS)) {
+            ErrorHandler::error(
+                m_file_name,
+                line,
+                "[Druing codegen] Pointers can only be offset by adding or subtracting an int",
+                line);
+        }
+    }
+
+    return t1;
+}
+
 jl::TempVar jl::Chunk::write(
     OpCode opcode,
     TempVar op1,
@@ -180,24 +242,7 @@ jl::TempVar jl::Chunk::write(
 {
     const auto inferred_type = handle_binary_type_inference(op1, op2, opcode, line);
     const auto dest = m_var_manager.create_temp_var(inferred_type);
-    auto type = OperandType::UNASSIGNED;
-
-    const auto t1 = get_nested_type(op1);
-    const auto t2 = get_nested_type(op2);
-
-    if (t1 == t2 && t2 == OperandType::FLOAT) {
-        type = OperandType::FLOAT;
-    } else if (t1 == t2 && t2 == OperandType::INT) {
-        type = OperandType::INT;
-    } else if (t1 == OperandType::FLOAT && t2 == OperandType::INT) {
-        // typecast t2 to int
-        op2 = write_type_cast(op2, OperandType::INT, OperandType::FLOAT, line);
-        type = OperandType::FLOAT;
-    } else if (t2 == OperandType::FLOAT && t1 == OperandType::INT) {
-        // typecast t1 to int
-        op1 = write_type_cast(op1, OperandType::INT, OperandType::FLOAT, line);
-        type = OperandType::FLOAT;
-    }
+    const auto type = prepare_binary_operands(op1, op2, opcode, line);
 
     m_ir.push_back(Ir { BinaryIr {
         opcode,
@@ -237,16 +282,7 @@ void jl::Chunk::write_with_dest(
         return;
     }
 
-    auto type = OperandType::UNASSIGNED;
-
-    const auto t1 = get_nested_type(op1);
-    const auto t2 = get_nested_type(op2);
-
-    if (t1 == t2 && t2 == OperandType::FLOAT) {
-        type = OperandType::FLOAT;
-    } else {
-        type = OperandType::INT;
-    }
+    const auto type = prepare_binary_operands(op1, op2, opcode, line);
 
     m_ir.push_back(Ir { BinaryIr {
         opcode,
@@ -514,4 +550,22 @@ void jl::Chunk::pop_block()
 void jl::Chunk::register_function(uint32_t temp_var, const std::string& name)
 {
     m_registered_functions.push_back({ temp_var, name });
+}
+
+bool jl::Chunk::is_variable(uint32_t idx) const
+{
+    return m_var_manager.is_variable(idx);
+}
+
+void jl::Chunk::remap_temps(const std::vector<uint32_t>& new_index, uint32_t new_count)
+{
+    for (auto& ir : m_ir) {
+        rename_temps(ir, [&](uint32_t idx) { return new_index[idx]; });
+    }
+
+    for (auto& [temp, name] : m_registered_functions) {
+        temp = new_index[temp];
+    }
+
+    m_var_manager.remap_temps(new_index, new_count);
 }
\ No newline at end of file
@@ -66,6 +66,10 @@ public:
 
     const std::vector<Ir>& get_ir() const;
     std::vector<Ir>& get_ir_mut();
+    // Removes every ir whose flag is set, along with its line
+    void remove_ir(const std::vector<bool>& removed);
+    // Inserts the ir and their lines before the ir at `position`
+    void insert_ir(uint32_t position, const std::vector<Ir>& irs, const std::vector<uint32_t>& lines);
     const std::vector<uint32_t> get_lines() const;
 
     uint32_t get_max_allocated_temps() const;
@@ -79,6 +83,7 @@ public:
     const std::unordered_map<std::string, uint32_t>& get_variable_map() const;
     const std::vector<std::string>& get_input_variable_names() const;
     OperandType get_nested_type(const Operand& operand) const;
+    bool is_variable(uint32_t idx) const;
 
     TempVar create_temp_var(OperandType type);
     int32_t create_new_label();
@@ -90,11 +95,18 @@ public:
     void push_block();
     void pop_block();
 
+    // Renames every temp var in the chunk, see VariableManager::remap_temps
+    void remap_temps(const std::vector<uint32_t>& new_index, uint32_t new_count);
+
     std::string m_name;
     OperandType return_type { OperandType::UNASSIGNED };
     std::vector<std::pair<uint32_t, std::string>> m_registered_functions;
     // Mark the chunk as an extern func or not
     std::optional<std::string> extern_symbol;
+    // Library of an extern func, if not the default one
+    std::optional<std::string> extern_library;
+    // An extern func taking any number of arguments after its parameters
+    bool is_variadic { false };
 
 private:
     std::string m_file_name { "test" };
@@ -105,6 +117,7 @@ private:
     std::vector<std::string> m_inputs;
 
     OperandType handle_binary_type_inference(jl::Operand op1, jl::Operand op2, OpCode opcode, uint32_t line);
+    OperandType prepare_binary_operands(TempVar& op1, TempVar& op2, OpCode opcode, uint32_t line);
 };
 
 }
\ No newline at end of file
@@ -76,6 +76,18 @@ bool jl::CodeGenerator::check_if_func_exists(const std::string& name) const
     return m_chunk_list.contains(name);
 }
 
+std::optional<std::string> jl::CodeGenerator::function_name_of(TempVar var) const
+{
+    std::optional<std::string> func_name;
+    for (const auto& [temp, name] : m_chunk->m_registered_functions) {
+        if (temp == var.idx) {
+            func_name = name;
+        }
+    }
+
+    return func_name;
+}
+
 void jl::CodeGenerator::push_chunk(Chunk&& chunk, const std::string& name)
 {
     m_chunk_list.insert({ name, std::move(chunk) });
@@ -312,6 +324,12 @@ std::any jl::CodeGenerator::visit_assign_expr(Assign* expr)
 
 std::any jl::CodeGenerator::visit_call_expr(Call* expr)
 {
+    // The map intrinsic, unless the program has its own map function
+    const auto* callee_var = dynamic_cast<Variable*>(expr->m_callee);
+    if (callee_var && callee_var->m_name.get_lexeme() == "map" && !check_if_func_exists("map")) {
+        return compile_map(expr);
+    }
+
     // Compile the callee
     const auto func_temp_var = compile(expr->m_callee);
     const auto line = expr->m_paren.get_line();
@@ -323,12 +341,7 @@ std::any jl::CodeGenerator::visit_call_expr(Call* expr)
     }
 
     // Ensure temp-var is associated with a named function
-    std::optional<std::string> func_name;
-    for (const auto& [temp, name] : m_chunk->m_registered_functions) {
-        if (temp == (func_temp_var).idx) {
-            func_name = name;
-        }
-    }
+    const auto func_name = function_name_of(func_temp_var);
 
     if (!func_name || !check_if_func_exists(*func_name)) {
         ErrorHandler::error(m_file_name, line, "No such function exists");
@@ -340,7 +353,9 @@ std::any jl::CodeGenerator::visit_call_expr(Call* expr)
     const auto& func_inputs = func_chunk.get_input_variable_names();
 
     // Ensure whether the arity is same
-    if (func_inputs.size() != expr->m_arguments.size()) {
+    const bool too_few = expr->m_arguments.size() < func_inputs.size();
+    const bool too_many = expr->m_arguments.size() > func_inputs.size() && !func_chunk.is_variadic;
+    if (too_few || too_many) {
         ErrorHandler::error(m_file_name, line, "No. of func arguments is wrong");
         return empty_var();
     }
@@ -348,10 +363,30 @@ std::any jl::CodeGenerator::visit_call_expr(Call* expr)
     std::vector<TempVar> args;
 
     // Compile all the function arguments
-    for (int i = 0; i < expr->m_arguments.size(); i++) {
+    for (size_t i = 0; i < expr->m_arguments.size(); i++) {
         auto arg = expr->m_arguments[i];
         const auto arg_var = compile(arg);
 
+        // Variable arguments take any type, a char is promoted to an int
+        // like c does
+        if (i >= func_inputs.size()) {
+            const auto type = m_chunk->get_nested_type(arg_var);
+
+            if (type == OperandType::NIL || type == OperandType::UNASSIGNED) {
+                ErrorHandler::error(
+                    m_file_name,
+                    line,
+                    std::format("Func argument {} has no value to pass", i).c_str());
+            }
+
+            if (type == OperandType::CHAR) {
+                args.push_back(m_chunk->write_type_cast(arg_var, type, OperandType::INT, line));
+            } else {
+                args.push_back(arg_var);
+            }
+            continue;
+        }
+
         // The data type should be same as function signature
         const auto& arg_name = func_inputs[i];
         const auto temp = *func_chunk.look_up_variable(arg_name);
@@ -386,6 +421,106 @@ std::any jl::CodeGenerator::visit_call_expr(Call* expr)
     return ret_var;
 }
 
+jl::TempVar jl::CodeGenerator::compile_map(Call* expr)
+{
+    const auto line = expr->m_paren.get_line();
+
+    if (expr->m_arguments.size() < 2) {
+        ErrorHandler::error(m_file_name, line, "map expects an extern function and a count");
+        return empty_var();
+    }
+
+    const auto func_temp_var = compile(expr->m_arguments[0]);
+    const auto func_name = function_name_of(func_temp_var);
+
+    if (!func_name || !check_if_func_exists(*func_name)) {
+        ErrorHandler::error(m_file_name, line, "No such function exists");
+        return empty_var();
+    }
+
+    // Only externs run in a native loop
+    const auto& func_chunk = m_chunk_list.at(*func_name);
+    if (!func_chunk.extern_symbol || func_chunk.is_variadic) {
+        ErrorHandler::error(m_file_name, line, "Only non variadic extern functions can be mapped");
+        return empty_var();
+    }
+
+    std::vector<TempVar> args;
+
+    const auto count = compile(expr->m_arguments[1]);
+    if (m_chunk->get_nested_type(count) != OperandType::INT) {
+        ErrorHandler::error(m_file_name, line, "map count should be an int");
+    }
+    args.push_back(count);
+
+    // The results are written to an array of the return type
+    const auto& func_inputs = func_chunk.get_input_variable_names();
+    const bool has_dest = func_chunk.return_type != OperandType::NIL;
+
+    if (expr->m_arguments.size() != 2 + has_dest + func_inputs.size()) {
+        ErrorHandler::error(m_file_name, line, "No. of func arguments is wrong");
+        return empty_var();
+    }
+
+    if (has_dest) {
+        // Results are stored as elements of the return type, and there are
+        // no arrays of pointers
+        const auto expected_type = into_ptr(func_chunk.return_type);
+        if (!expected_type) {
+            ErrorHandler::error(m_file_name, line, "Extern functions returning a pointer cannot be mapped");
+            return empty_var();
+        }
+
+        const auto dest = compile(expr->m_arguments[2]);
+        const auto actual_type = m_chunk->get_nested_type(dest);
+
+        if (expected_type != actual_type) {
+            ErrorHandler::error(
+                m_file_name,
+                line,
+                std::format("map destination type mismatch. Expected {} found {}",
+                    to_string(*expected_type),
+                    to_string(actual_type))
+                    .c_str());
+        }
+        args.push_back(dest);
+    }
+
+    // Every argument is either an array with an element per call or a
+    // value passed to every call
+    for (size_t i = 0; i < func_inputs.size(); i++) {
+        const auto arg_var = compile(expr->m_arguments[2 + has_dest + i]);
+        const auto temp = *func_chunk.look_up_variable(func_inputs[i]);
+
+        const auto expected_type = func_chunk.get_nested_type(temp);
+        const auto actual_type = m_chunk->get_nested_type(arg_var);
+
+        if (actual_type != expected_type && actual_type != into_ptr(expected_type)) {
+            ErrorHandler::error(
+                m_file_name,
+                line,
+                std::format("Func argument {} type mismatch. Expected {} or an array of it found {}",
+                    i,
+                    to_string(expected_type),
+                    to_string(actual_type))
+                    .c_str());
+        }
+
+        args.push_back(arg_var);
+    }
+
+    m_chunk->write_call(
+        OpCode::MAP,
+        func_temp_var,
+        *func_name,
+        empty_var(),
+        std::move(args),
+        func_chunk.extern_symbol,
+        line);
+
+    return empty_var();
+}
+
 std::any jl::CodeGenerator::visit_index_get_expr(IndexGet* expr)
 {
     const auto list_ptr = compile(expr->m_jlist);
@@ -408,13 +543,8 @@ std::any jl::CodeGenerator::visit_index_get_expr(IndexGet* expr)
         return empty_var();
     }
 
-    // Calulate offset
-    const auto ele_type = *from_ptr(list_ptr_type);
-    const auto oper_size = m_chunk->write(OpCode::MOVE, Operand { (int_type)size_of_type(ele_type) }, m_chunk->get_last_line());
-    const auto offset = m_chunk->write(OpCode::STAR, idx, oper_size, m_chunk->get_last_line());
-
-    // Calculate relative address
-    const auto addr = m_chunk->write(OpCode::ADD, list_ptr, offset, m_chunk->get_last_line());
+    // Pointer arithmetic is scaled by the element size
+    const auto addr = m_chunk->write(OpCode::ADD, list_ptr, idx, m_chunk->get_last_line());
     const auto result_var = m_chunk->create_temp_var(*from_ptr(list_ptr_type));
     // m_chunk->write_with_dest(OpCode::LOAD, addr, result_var, m_chunk->get_last_line());
     m_chunk->write_load_store(OpCode::LOAD, addr, result_var, m_chunk->get_last_line());
@@ -459,14 +589,8 @@ std::any jl::CodeGenerator::visit_index_set_expr(IndexSet* expr)
         return empty_var();
     }
 
-    // Calulate offset
-    const auto ele_type = *from_ptr(list_ptr_type);
-    const auto oper_size = m_chunk->write(OpCode::MOVE, Operand { (int_type)size_of_type(ele_type) }, m_chunk->get_last_line());
-    const auto offset = m_chunk->write(OpCode::STAR, idx, oper_size, m_chunk->get_last_line());
-    // TODO:: Do a typecast here for int to ptr_var??
-
-    // Calculate relative address
-    const auto addr = m_chunk->write(OpCode::ADD, list_ptr, offset, m_chunk->get_last_line());
+    // Pointer arithmetic is scaled by the element size
+    const auto addr = m_chunk->write(OpCode::ADD, list_ptr, idx, m_chunk->get_last_line());
     // m_chunk->write_jump_or_store(OpCode::STORE, new_value, addr, m_chunk->get_last_line());
     m_chunk->write_load_store(OpCode::STORE, addr, new_value, m_chunk->get_last_line());
     return addr;
@@ -751,6 +875,7 @@ std::any jl::CodeGenerator::visit_func_stmt(FuncStmt* stmt)
 
     // Store the return type
     m_chunk->return_type = return_type;
+    m_chunk->is_variadic = stmt->m_is_variadic;
 
     std::vector<TempVar> parameter_vars;
 
@@ -829,6 +954,10 @@ std::any jl::CodeGenerator::visit_extern_stmt(ExternStmt* stmt)
     // Get the just compiled function
     auto& chunk = m_chunk_list.at(stmt->m_june_func->m_name.get_lexeme());
     chunk.extern_symbol = symbol_name;
+
+    if (stmt->m_library_name) {
+        chunk.extern_library = std::get<std::string>(stmt->m_library_name->get_value()->get());
+    }
     return empty_var();
 }
 
@@ -66,6 +66,10 @@ private:
 
     TempVar empty_var();
     bool check_if_func_exists(const std::string& name) const;
+    // Name of the function a temp var refers to, if any
+    std::optional<std::string> function_name_of(TempVar var) const;
+    // map(func, count, [dest,] args...) calls an extern for every element
+    TempVar compile_map(Call* expr);
     void push_chunk(Chunk&& chunk, const std::string& name);
     void pop_chunk();
 };
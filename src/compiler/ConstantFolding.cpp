@@ -0,0 +1,418 @@
+#include "ConstantFolding.hpp"
+
+#include "ControlFlowGraph.hpp"
+#include "Ir.hpp"
+#include "OpCode.hpp"
+#include "Operand.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+// The known constant in every temp var, nullopt if the value is unknown
+using State = std::vector<std::optional<jl::Operand>>;
+
+static bool is_foldable(jl::OperandType type)
+{
+    switch (type) {
+    case jl::OperandType::INT:
+    case jl::OperandType::FLOAT:
+    case jl::OperandType::BOOL:
+    case jl::OperandType::CHAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool same_constant(const jl::Operand& a, const jl::Operand& b)
+{
+    using jl::OperandType;
+
+    if (jl::get_type(a) != jl::get_type(b)) {
+        return false;
+    }
+
+    switch (jl::get_type(a)) {
+    case OperandType::INT:
+        return std::get<jl::int_type>(a) == std::get<jl::int_type>(b);
+    case OperandType::FLOAT:
+        // 0.0 and -0.0 compare equal but are different constants
+        return std::bit_cast<uint64_t>(std::get<jl::float_type>(a))
+            == std::bit_cast<uint64_t>(std::get<jl::float_type>(b));
+    case OperandType::BOOL:
+        return std::get<bool>(a) == std::get<bool>(b);
+    case OperandType::CHAR:
+        return std::get<char>(a) == std::get<char>(b);
+    default:
+        return false;
+    }
+}
+
+template <typename T>
+static std::optional<jl::Operand> fold_comparison(jl::OpCode opcode, T a, T b)
+{
+    using jl::OpCode;
+
+    switch (opcode) {
+    case OpCode::LESS:
+        return jl::Operand { std::in_place_type<bool>, a < b };
+    case OpCode::LESS_EQUAL:
+        return jl::Operand { std::in_place_type<bool>, a <= b };
+    case OpCode::GREATER:
+        return jl::Operand { std::in_place_type<bool>, a > b };
+    case OpCode::GREATER_EQUAL:
+        return jl::Operand { std::in_place_type<bool>, a >= b };
+    case OpCode::EQUAL:
+        return jl::Operand { std::in_place_type<bool>, a == b };
+    case OpCode::NOT_EQUAL:
+        return jl::Operand { std::in_place_type<bool>, a != b };
+    default:
+        return std::nullopt;
+    }
+}
+
+// Integer arithmetic wraps around like it does in the VM. Division by zero
+// is left for the VM to run into.
+static std::optional<jl::Operand> fold_int(jl::OpCode opcode, jl::int_type a, jl::int_type b)
+{
+    using jl::int_type;
+    using jl::OpCode;
+
+    const auto wrap = [](uint32_t value) {
+        return jl::Operand { static_cast<int_type>(value) };
+    };
+    const bool divisible = b != 0 && !(a == std::numeric_limits<int_type>::min() && b == -1);
+
+    switch (opcode) {
+    case OpCode::ADD:
+        return wrap(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+    case OpCode::MINUS:
+        return wrap(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+    case OpCode::STAR:
+        return wrap(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+    case OpCode::SLASH:
+        return divisible ? std::optional { jl::Operand { static_cast<int_type>(a / b) } } : std::nullopt;
+    case OpCode::MODULUS:
+        return divisible ? std::optional { jl::Operand { static_cast<int_type>(a % b) } } : std::nullopt;
+    case OpCode::BIT_AND:
+        return jl::Operand { static_cast<int_type>(a & b) };
+    case OpCode::BIT_OR:
+        return jl::Operand { static_cast<int_type>(a | b) };
+    case OpCode::BIT_XOR:
+        return jl::Operand { static_cast<int_type>(a ^ b) };
+    default:
+        return fold_comparison(opcode, a, b);
+    }
+}
+
+static std::optional<jl::Operand> fold_float(jl::OpCode opcode, jl::float_type a, jl::float_type b)
+{
+    using jl::OpCode;
+
+    switch (opcode) {
+    case OpCode::ADD:
+        return jl::Operand { a + b };
+    case OpCode::MINUS:
+        return jl::Operand { a - b };
+    case OpCode::STAR:
+        return jl::Operand { a * b };
+    case OpCode::SLASH:
+        return jl::Operand { a / b };
+    default:
+        return fold_comparison(opcode, a, b);
+    }
+}
+
+static std::optional<jl::Operand> fold_bool(jl::OpCode opcode, bool a, bool b)
+{
+    using jl::OpCode;
+
+    switch (opcode) {
+    case OpCode::AND:
+        return jl::Operand { std::in_place_type<bool>, a && b };
+    case OpCode::OR:
+        return jl::Operand { std::in_place_type<bool>, a || b };
+    default:
+        return fold_comparison(opcode, a, b);
+    }
+}
+
+static std::optional<jl::Operand> fold_binary(
+    jl::OpCode opcode,
+    jl::OperandType type,
+    const jl::Operand& a,
+    const jl::Operand& b)
+{
+    using jl::OperandType;
+
+    switch (type) {
+    case OperandType::INT:
+        return fold_int(opcode, std::get<jl::int_type>(a), std::get<jl::int_type>(b));
+    case OperandType::FLOAT:
+        return fold_float(opcode, std::get<jl::float_type>(a), std::get<jl::float_type>(b));
+    case OperandType::BOOL:
+        return fold_bool(opcode, std::get<bool>(a), std::get<bool>(b));
+    case OperandType::CHAR:
+        return fold_comparison(opcode, std::get<char>(a), std::get<char>(b));
+    default:
+        return std::nullopt;
+    }
+}
+
+// Float values which do not fit the integer type are left for the VM
+template <typename T>
+static std::optional<jl::Operand> float_to_integer(jl::float_type value)
+{
+    if (!(value >= std::numeric_limits<T>::min() && value <= std::numeric_limits<T>::max())) {
+        return std::nullopt;
+    }
+
+    return jl::Operand { std::in_place_type<T>, static_cast<T>(value) };
+}
+
+static std::optional<jl::Operand> fold_cast(
+    jl::OperandType from,
+    jl::OperandType to,
+    const jl::Operand& value)
+{
+    using jl::OperandType;
+
+    if (from == to) {
+        return value;
+    }
+
+    if (from == OperandType::INT && to == OperandType::FLOAT) {
+        return jl::Operand { static_cast<jl::float_type>(std::get<jl::int_type>(value)) };
+    } else if (from == OperandType::FLOAT && to == OperandType::INT) {
+        return float_to_integer<jl::int_type>(std::get<jl::float_type>(value));
+    } else if (from == OperandType::INT && to == OperandType::CHAR) {
+        return jl::Operand { static_cast<char>(std::get<jl::int_type>(value)) };
+    } else if (from == OperandType::CHAR && to == OperandType::INT) {
+        return jl::Operand { static_cast<jl::int_type>(std::get<char>(value)) };
+    } else if (from == OperandType::FLOAT && to == OperandType::CHAR) {
+        return float_to_integer<char>(std::get<jl::float_type>(value));
+    } else if (from == OperandType::CHAR && to == OperandType::FLOAT) {
+        return jl::Operand { static_cast<jl::float_type>(std::get<char>(value)) };
+    }
+
+    return std::nullopt;
+}
+
+static std::optional<jl::Operand> constant_of(const State& state, const jl::Operand& operand)
+{
+    const auto type = jl::get_type(operand);
+
+    if (type == jl::OperandType::TEMP) {
+        return state[std::get<jl::TempVar>(operand).idx];
+    } else if (is_foldable(type)) {
+        return operand;
+    }
+
+    return std::nullopt;
+}
+
+// The constant written by the ir, if it can be computed at compile time
+static std::optional<jl::Operand> evaluate(const jl::Chunk& chunk, const State& state, const jl::Ir& ir)
+{
+    using jl::Ir;
+    using jl::OpCode;
+    using jl::OperandType;
+
+    std::optional<jl::Operand> result;
+
+    switch (ir.type()) {
+    case Ir::UNARY: {
+        const auto& un = ir.unary();
+        const auto value = constant_of(state, un.operand);
+        if (!value) {
+            break;
+        }
+
+        if (un.opcode == OpCode::MOVE) {
+            result = value;
+        } else if (un.opcode == OpCode::NOT && jl::get_type(*value) == OperandType::BOOL) {
+            result = jl::Operand { std::in_place_type<bool>, !std::get<bool>(*value) };
+        } else if (un.opcode == OpCode::BIT_NOT && jl::get_type(*value) == OperandType::INT) {
+            result = jl::Operand { static_cast<jl::int_type>(~std::get<jl::int_type>(*value)) };
+        }
+    } break;
+    case Ir::BINARY: {
+        const auto& bin = ir.binary();
+        const auto op1 = state[bin.op1.idx];
+        const auto op2 = state[bin.op2.idx];
+
+        if (op1 && op2 && jl::get_type(*op1) == bin.type && jl::get_type(*op2) == bin.type) {
+            result = fold_binary(bin.opcode, bin.type, *op1, *op2);
+        }
+    } break;
+    case Ir::TYPE_CAST: {
+        const auto& cast = ir.cast();
+        const auto source = state[cast.source.idx];
+
+        if (source && jl::get_type(*source) == cast.from) {
+            result = fold_cast(cast.from, cast.to, *source);
+        }
+    } break;
+    default:
+        break;
+    }
+
+    // Constants are only tracked in temps of the same type
+    if (result && jl::get_type(*result) != chunk.get_nested_type(ir.dest())) {
+        return std::nullopt;
+    }
+
+    return result;
+}
+
+static void transfer(const jl::Chunk& chunk, State& state, const jl::Ir& ir)
+{
+    if (const auto def = jl::get_def(ir)) {
+        state[*def] = evaluate(chunk, state, ir);
+    }
+}
+
+// The blocks control can flow to from the end of the block, branches on a
+// known condition only take one side
+static std::vector<uint32_t> reachable_successors(
+    const jl::Chunk& chunk,
+    const jl::ControlFlowGraph& cfg,
+    const std::vector<uint32_t>& labels,
+    const State& state,
+    uint32_t b)
+{
+    const auto& block = cfg.blocks[b];
+    const auto& last = chunk.get_ir()[block.end - 1];
+
+    if (last.opcode() == jl::OpCode::JMP_UNLESS) {
+        const auto cond = state[last.jump().data.idx];
+
+        if (cond && jl::get_type(*cond) == jl::OperandType::BOOL) {
+            if (!std::get<bool>(*cond)) {
+                return { cfg.block_of[labels[std::get<int>(last.jump().target)]] };
+            } else if (block.end < chunk.get_ir().size()) {
+                return { cfg.block_of[block.end] };
+            }
+            return {};
+        }
+    }
+
+    return block.successors;
+}
+
+// Constants known at the entry of every block, nullopt for blocks that are
+// never reached
+static std::vector<std::optional<State>> analyse(
+    const jl::Chunk& chunk,
+    const jl::ControlFlowGraph& cfg,
+    const std::vector<uint32_t>& labels)
+{
+    const auto temps = chunk.get_max_allocated_temps();
+    std::vector<std::optional<State>> entry(cfg.blocks.size());
+
+    if (cfg.blocks.empty()) {
+        return entry;
+    }
+
+    // Parameters and variables read before being written are unknown
+    entry[0] = State(temps);
+    std::vector<uint32_t> worklist { 0 };
+
+    while (!worklist.empty()) {
+        const auto b = worklist.back();
+        worklist.pop_back();
+
+        auto state = *entry[b];
+        for (uint32_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            transfer(chunk, state, chunk.get_ir()[i]);
+        }
+
+        for (const auto succ : reachable_successors(chunk, cfg, labels, state, b)) {
+            if (!entry[succ]) {
+                entry[succ] = state;
+                worklist.push_back(succ);
+                continue;
+            }
+
+            bool changed = false;
+            for (uint32_t t = 0; t < temps; t++) {
+                auto& known = (*entry[succ])[t];
+                if (known && (!state[t] || !same_constant(*known, *state[t]))) {
+                    known = std::nullopt;
+                    changed = true;
+                }
+            }
+
+            if (changed) {
+                worklist.push_back(succ);
+            }
+        }
+    }
+
+    return entry;
+}
+
+static bool fold_once(jl::Chunk& chunk)
+{
+    using jl::Ir;
+    using jl::OpCode;
+
+    const auto cfg = jl::build_cfg(chunk);
+    const auto labels = jl::find_labels(chunk);
+    const auto entry = analyse(chunk, cfg, labels);
+
+    auto& irs = chunk.get_ir_mut();
+    std::vector<bool> removed(irs.size(), false);
+    bool changed = false;
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        // Unreachable blocks are left for dead code elimination
+        if (!entry[b]) {
+            continue;
+        }
+
+        auto state = *entry[b];
+        for (uint32_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            auto& ir = irs[i];
+            const auto def = jl::get_def(ir);
+            const auto result = evaluate(chunk, state, ir);
+
+            const bool is_constant_move = ir.type() == Ir::UNARY
+                && ir.opcode() == OpCode::MOVE
+                && jl::get_type(ir.unary().operand) != jl::OperandType::TEMP;
+
+            if (result && !is_constant_move) {
+                ir = Ir { jl::UnaryIr { OpCode::MOVE, *result, jl::TempVar { *def } } };
+                changed = true;
+            } else if (ir.opcode() == OpCode::JMP_UNLESS) {
+                const auto cond = state[ir.jump().data.idx];
+
+                if (cond && jl::get_type(*cond) == jl::OperandType::BOOL) {
+                    if (std::get<bool>(*cond)) {
+                        removed[i] = true;
+                    } else {
+                        ir = Ir { jl::ControlIr { OpCode::JMP, ir.jump().target } };
+                    }
+                    changed = true;
+                }
+            }
+
+            if (def) {
+                state[*def] = result;
+            }
+        }
+    }
+
+    chunk.remove_ir(removed);
+
+    return changed;
+}
+
+void jl::fold_constants(Chunk& chunk)
+{
+    // Removing a branch can make more of the chunk constant
+    while (fold_once(chunk)) { }
+}
\ No newline at end of file
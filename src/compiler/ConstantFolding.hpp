@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+namespace jl {
+
+// Propagates constants through temp vars and evaluates arithmetic,
+// comparisons and casts on them at compile time. Branches on a constant
+// condition become plain jumps or are removed.
+void fold_constants(Chunk& chunk);
+
+}
\ No newline at end of file
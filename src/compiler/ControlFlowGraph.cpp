@@ -0,0 +1,338 @@
+#include "ControlFlowGraph.hpp"
+
+#include "Ir.hpp"
+#include "OpCode.hpp"
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <string>
+
+std::vector<uint32_t> jl::find_labels(const Chunk& chunk)
+{
+    const auto& irs = chunk.get_ir();
+    std::vector<uint32_t> labels(chunk.get_max_labels(), irs.size());
+
+    for (uint32_t i = 0; i < irs.size(); i++) {
+        if (irs[i].type() == Ir::CONTROL && irs[i].opcode() == OpCode::LABEL) {
+            labels[std::get<int>(irs[i].control().data)] = i;
+        }
+    }
+
+    return labels;
+}
+
+static bool ends_block(const jl::Ir& ir)
+{
+    switch (ir.opcode()) {
+    case jl::OpCode::JMP:
+    case jl::OpCode::JMP_UNLESS:
+    case jl::OpCode::RETURN:
+    case jl::OpCode::HALT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Blocks reachable from the entry, each one after all of its predecessors
+// except those reached through a back edge
+static std::vector<uint32_t> reverse_post_order(const jl::ControlFlowGraph& cfg)
+{
+    std::vector<uint32_t> post_order;
+    std::vector<bool> visited(cfg.blocks.size(), false);
+    // Block and the index of the next successor to visit
+    std::vector<std::pair<uint32_t, uint32_t>> stack { { 0, 0 } };
+    visited[0] = true;
+
+    while (!stack.empty()) {
+        auto& [block, next] = stack.back();
+        const auto& successors = cfg.blocks[block].successors;
+
+        if (next < successors.size()) {
+            const auto succ = successors[next++];
+            if (!visited[succ]) {
+                visited[succ] = true;
+                stack.push_back({ succ, 0 });
+            }
+        } else {
+            post_order.push_back(block);
+            stack.pop_back();
+        }
+    }
+
+    std::ranges::reverse(post_order);
+    return post_order;
+}
+
+// Cooper, Harvey and Kennedy's iterative algorithm
+static void compute_dominators(jl::ControlFlowGraph& cfg)
+{
+    constexpr auto no_block = jl::ControlFlowGraph::no_block;
+
+    cfg.idom.assign(cfg.blocks.size(), no_block);
+    if (cfg.blocks.empty()) {
+        return;
+    }
+
+    const auto order = reverse_post_order(cfg);
+    std::vector<uint32_t> order_index(cfg.blocks.size(), no_block);
+    for (uint32_t i = 0; i < order.size(); i++) {
+        order_index[order[i]] = i;
+    }
+
+    const auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b) {
+            while (order_index[a] > order_index[b]) {
+                a = cfg.idom[a];
+            }
+            while (order_index[b] > order_index[a]) {
+                b = cfg.idom[b];
+            }
+        }
+        return a;
+    };
+
+    cfg.idom[0] = 0;
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (const auto block : order) {
+            if (block == 0) {
+                continue;
+            }
+
+            auto new_idom = no_block;
+            for (const auto pred : cfg.blocks[block].predecessors) {
+                if (cfg.idom[pred] == no_block) {
+                    continue;
+                }
+                new_idom = new_idom == no_block ? pred : intersect(pred, new_idom);
+            }
+
+            if (cfg.idom[block] != new_idom) {
+                cfg.idom[block] = new_idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+static void find_loops(jl::ControlFlowGraph& cfg)
+{
+    // Loops with the same header are merged into one
+    std::map<uint32_t, jl::Loop> by_header;
+
+    for (uint32_t block = 0; block < cfg.blocks.size(); block++) {
+        if (!cfg.is_reachable(block)) {
+            continue;
+        }
+
+        for (const auto succ : cfg.blocks[block].successors) {
+            if (!cfg.dominates(succ, block)) {
+                continue;
+            }
+
+            auto& loop = by_header[succ];
+            loop.header = succ;
+            loop.latches.push_back(block);
+
+            std::vector<bool> in_loop(cfg.blocks.size(), false);
+            for (const auto b : loop.blocks) {
+                in_loop[b] = true;
+            }
+
+            // Walk backwards from the latch until the header
+            std::vector<uint32_t> worklist { succ, block };
+            while (!worklist.empty()) {
+                const auto b = worklist.back();
+                worklist.pop_back();
+
+                if (in_loop[b]) {
+                    continue;
+                }
+                in_loop[b] = true;
+                loop.blocks.push_back(b);
+
+                if (b == succ) {
+                    continue;
+                }
+                for (const auto pred : cfg.blocks[b].predecessors) {
+                    if (cfg.is_reachable(pred)) {
+                        worklist.push_back(pred);
+                    }
+                }
+            }
+
+            std::ranges::sort(loop.blocks);
+        }
+    }
+
+    cfg.loops.clear();
+    for (auto& [header, loop] : by_header) {
+        cfg.loops.push_back(std::move(loop));
+    }
+
+    // A loop nested in another one has fewer blocks
+    std::ranges::stable_sort(cfg.loops, std::greater {}, [](const jl::Loop& loop) {
+        return loop.blocks.size();
+    });
+
+    cfg.loop_of.assign(cfg.blocks.size(), std::nullopt);
+
+    for (uint32_t i = 0; i < cfg.loops.size(); i++) {
+        auto& loop = cfg.loops[i];
+
+        // The innermost loop containing the header is the last one found
+        loop.parent = cfg.loop_of[loop.header];
+        loop.depth = loop.parent ? cfg.loops[*loop.parent].depth + 1 : 1;
+
+        for (const auto b : loop.blocks) {
+            cfg.loop_of[b] = i;
+        }
+    }
+}
+
+jl::ControlFlowGraph jl::build_cfg(const Chunk& chunk)
+{
+    const auto& irs = chunk.get_ir();
+    const auto labels = find_labels(chunk);
+    ControlFlowGraph cfg;
+    cfg.block_of.resize(irs.size());
+
+    // Split the ir into blocks at labels and after every jump or return
+    for (uint32_t i = 0; i < irs.size(); i++) {
+        const bool is_label = irs[i].type() == Ir::CONTROL && irs[i].opcode() == OpCode::LABEL;
+
+        if (cfg.blocks.empty() || is_label || ends_block(irs[i - 1])) {
+            cfg.blocks.push_back(BasicBlock { .begin = i, .end = i });
+        }
+
+        cfg.blocks.back().end = i + 1;
+        cfg.block_of[i] = cfg.blocks.size() - 1;
+    }
+
+    const auto add_edge = [&](uint32_t from, uint32_t to_ir) {
+        if (to_ir >= irs.size()) {
+            return;
+        }
+
+        const auto to = cfg.block_of[to_ir];
+        cfg.blocks[from].successors.push_back(to);
+        cfg.blocks[to].predecessors.push_back(from);
+    };
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        const auto& last = irs[cfg.blocks[b].end - 1];
+
+        switch (last.opcode()) {
+        case OpCode::JMP:
+            add_edge(b, labels[std::get<int>(last.control().data)]);
+            break;
+        case OpCode::JMP_UNLESS:
+            add_edge(b, cfg.blocks[b].end);
+            add_edge(b, labels[std::get<int>(last.jump().target)]);
+            break;
+        case OpCode::RETURN:
+        case OpCode::HALT:
+            break;
+        default:
+            add_edge(b, cfg.blocks[b].end);
+            break;
+        }
+    }
+
+    compute_dominators(cfg);
+    find_loops(cfg);
+
+    return cfg;
+}
+
+bool jl::ControlFlowGraph::is_reachable(uint32_t block) const
+{
+    return idom[block] != no_block;
+}
+
+bool jl::ControlFlowGraph::dominates(uint32_t dominator, uint32_t block) const
+{
+    if (!is_reachable(block)) {
+        return false;
+    }
+
+    while (block != dominator) {
+        if (block == 0) {
+            return false;
+        }
+        block = idom[block];
+    }
+
+    return true;
+}
+
+uint32_t jl::ControlFlowGraph::loop_depth(uint32_t block) const
+{
+    return loop_of[block] ? loops[*loop_of[block]].depth : 0;
+}
+
+static std::string escape_dot(const std::string& text)
+{
+    std::string escaped;
+
+    for (const auto c : text) {
+        switch (c) {
+        case '"':
+        case '\\':
+            escaped += '\\';
+            escaped += c;
+            break;
+        case '\t':
+            escaped += "  ";
+            break;
+        case '\n':
+            escaped += "\\l";
+            break;
+        default:
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+void jl::print_dot(std::ostream& out, const Chunk& chunk, const ControlFlowGraph& cfg)
+{
+    out << "digraph \"" << escape_dot(chunk.m_name) << "\" {\n";
+    out << "    node [shape=box, fontname=\"monospace\"];\n";
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        std::stringstream label;
+        label << "B" << b;
+        if (!cfg.is_reachable(b)) {
+            label << " (unreachable)";
+        } else if (cfg.loop_depth(b) > 0) {
+            label << " (loop depth " << cfg.loop_depth(b) << ")";
+        }
+        label << '\n';
+
+        for (uint32_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            chunk.print_ir(label, chunk.get_ir()[i]);
+            label << '\n';
+        }
+
+        out << "    B" << b << " [label=\"" << escape_dot(label.str()) << "\"];\n";
+    }
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        for (const auto succ : cfg.blocks[b].successors) {
+            out << "    B" << b << " -> B" << succ;
+            if (cfg.dominates(succ, b)) {
+                out << " [style=dashed]";
+            }
+            out << ";\n";
+        }
+    }
+
+    out << "}\n";
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+#include "Chunk.hpp"
+
+namespace jl {
+
+struct BasicBlock {
+    // Range of ir in the block, end is one past the last ir
+    uint32_t begin;
+    uint32_t end;
+    std::vector<uint32_t> successors {};
+    std::vector<uint32_t> predecessors {};
+};
+
+// A natural loop, made of every block that can reach a back edge to the
+// header without passing through the header
+struct Loop {
+    uint32_t header;
+    // Sorted, and includes the header and the blocks of nested loops
+    std::vector<uint32_t> blocks;
+    // Blocks with a back edge to the header
+    std::vector<uint32_t> latches;
+    // Index of the innermost loop containing this one
+    std::optional<uint32_t> parent;
+    uint32_t depth;
+};
+
+struct ControlFlowGraph {
+    static uint32_t constexpr no_block { UINT32_MAX };
+
+    // The first block is the entry of the chunk
+    std::vector<BasicBlock> blocks;
+    // Index of the block each ir belongs to
+    std::vector<uint32_t> block_of;
+    // Immediate dominator of every block. The entry block is its own
+    // dominator and unreachable blocks have none (no_block).
+    std::vector<uint32_t> idom;
+    // Outer loops come before the loops nested in them
+    std::vector<Loop> loops;
+    // Index of the innermost loop of every block, if any
+    std::vector<std::optional<uint32_t>> loop_of;
+
+    bool is_reachable(uint32_t block) const;
+    // Whether every path from the entry to `block` passes through `dominator`
+    bool dominates(uint32_t dominator, uint32_t block) const;
+    uint32_t loop_depth(uint32_t block) const;
+};
+
+ControlFlowGraph build_cfg(const Chunk& chunk);
+
+// Index of the ir of every label in the chunk
+std::vector<uint32_t> find_labels(const Chunk& chunk);
+
+// Writes the graph in the Graphviz dot format
+void print_dot(std::ostream& out, const Chunk& chunk, const ControlFlowGraph& cfg);
+
+}
\ No newline at end of file
@@ -37,15 +37,20 @@ jl::ptr_type jl::DataSection::add_data(size_t size)
 
 std::ostream& jl::DataSection::disassemble(std::ostream& out)
 {
-    int length = 32;
-    int start = 0;
-    int i;
+    return disassemble(out, m_data);
+}
+
+std::ostream& jl::DataSection::disassemble(std::ostream& out, std::span<const uint8_t> data)
+{
+    size_t length = 32;
+    size_t start = 0;
+    size_t i;
 
-    while (start < m_data.size()) {
+    while (start < data.size()) {
         out << std::hex << std::setfill('0') << std::setw(4) << start << ' ';
 
-        for (i = start; i < m_data.size() && i < start + length; i++) {
-            out << std::hex << std::setw(2) << (int)m_data[i];
+        for (i = start; i < data.size() && i < start + length; i++) {
+            out << std::hex << std::setw(2) << (int)data[i];
         }
         while (i < start + length) {
             out << std::hex << std::setw(2) << (int)0;
@@ -54,8 +59,8 @@ std::ostream& jl::DataSection::disassemble(std::ostream& out)
 
         out << "\t|\t";
 
-        for (i = start; i < m_data.size() && i < start + length; i++) {
-            out << m_data[i];
+        for (i = start; i < data.size() && i < start + length; i++) {
+            out << data[i];
         }
 
         while (i < start + length) {
@@ -75,6 +80,16 @@ void* jl::DataSection::data()
     return m_data.data();
 }
 
+const void* jl::DataSection::data() const
+{
+    return m_data.data();
+}
+
+size_t jl::DataSection::size() const
+{
+    return m_data.size();
+}
+
 std::optional<jl::ptr_type> jl::DataSection::get_last_offset()
 {
     const auto ret = m_last_offset;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ostream>
+#include <span>
 #include <vector>
 
 #include "Operand.hpp"
@@ -14,7 +15,11 @@ public:
 
     std::optional<ptr_type> get_last_offset();
     std::ostream& disassemble(std::ostream& out);
+    // Dumps any copy of a data section, like the one a VM ran with
+    static std::ostream& disassemble(std::ostream& out, std::span<const uint8_t> data);
     void* data();
+    const void* data() const;
+    size_t size() const;
 
 private:
     std::vector<uint8_t> m_data;
@@ -0,0 +1,140 @@
+#include "DeadCodeElimination.hpp"
+
+#include "ControlFlowGraph.hpp"
+#include "Ir.hpp"
+#include "Liveness.hpp"
+#include "OpCode.hpp"
+
+#include <cstdint>
+#include <vector>
+
+static bool is_label(const jl::Ir& ir, int label)
+{
+    return ir.type() == jl::Ir::CONTROL
+        && ir.opcode() == jl::OpCode::LABEL
+        && std::get<int>(ir.control().data) == label;
+}
+
+static bool remove_unreachable_code(jl::Chunk& chunk)
+{
+    const auto& irs = chunk.get_ir();
+    const auto cfg = jl::build_cfg(chunk);
+
+    if (cfg.blocks.empty()) {
+        return false;
+    }
+
+    std::vector<bool> reachable(cfg.blocks.size(), false);
+    std::vector<uint32_t> worklist { 0 };
+    reachable[0] = true;
+
+    while (!worklist.empty()) {
+        const auto b = worklist.back();
+        worklist.pop_back();
+
+        for (const auto succ : cfg.blocks[b].successors) {
+            if (!reachable[succ]) {
+                reachable[succ] = true;
+                worklist.push_back(succ);
+            }
+        }
+    }
+
+    std::vector<bool> removed(irs.size(), false);
+    bool changed = false;
+
+    for (uint32_t i = 0; i < irs.size(); i++) {
+        if (!reachable[cfg.block_of[i]]) {
+            removed[i] = true;
+            changed = true;
+        }
+    }
+
+    // A jump to a label which follows it, with only labels or removed ir in
+    // between, does nothing
+    for (uint32_t i = 0; i < irs.size(); i++) {
+        if (removed[i] || irs[i].type() != jl::Ir::CONTROL || irs[i].opcode() != jl::OpCode::JMP) {
+            continue;
+        }
+
+        const auto label = std::get<int>(irs[i].control().data);
+        for (uint32_t j = i + 1; j < irs.size(); j++) {
+            if (removed[j]) {
+                continue;
+            }
+            if (irs[j].opcode() != jl::OpCode::LABEL) {
+                break;
+            }
+            if (is_label(irs[j], label)) {
+                removed[i] = true;
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    chunk.remove_ir(removed);
+
+    return changed;
+}
+
+void jl::eliminate_dead_code(Chunk& chunk)
+{
+    while (remove_unreachable_code(chunk)) { }
+}
+
+static bool has_side_effects(const jl::Ir& ir)
+{
+    switch (ir.type()) {
+    case jl::Ir::UNARY:
+    case jl::Ir::BINARY:
+    case jl::Ir::TYPE_CAST:
+        return false;
+    case jl::Ir::LOAD_STORE:
+        return ir.load_store().opcode == jl::OpCode::STORE;
+    default:
+        return true;
+    }
+}
+
+static bool remove_dead_stores(jl::Chunk& chunk)
+{
+    const auto& irs = chunk.get_ir();
+    const auto cfg = jl::build_cfg(chunk);
+    const auto liveness = jl::compute_liveness(chunk, cfg);
+
+    std::vector<bool> removed(irs.size(), false);
+    bool changed = false;
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        const auto& block = cfg.blocks[b];
+        auto live = liveness.live_out[b];
+
+        for (uint32_t i = block.end; i-- > block.begin;) {
+            const auto def = jl::get_def(irs[i]);
+
+            if (def && !live[*def] && !has_side_effects(irs[i]) && !chunk.is_variable(*def)) {
+                removed[i] = true;
+                changed = true;
+                continue;
+            }
+
+            if (def) {
+                live[*def] = false;
+            }
+            for (const auto use : jl::get_uses(irs[i])) {
+                live[use] = true;
+            }
+        }
+    }
+
+    chunk.remove_ir(removed);
+
+    return changed;
+}
+
+void jl::eliminate_dead_stores(Chunk& chunk)
+{
+    // Removing a store can leave the stores to its operands dead
+    while (remove_dead_stores(chunk)) { }
+}
\ No newline at end of file
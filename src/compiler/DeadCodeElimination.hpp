@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+namespace jl {
+
+// Removes ir which control can never reach and jumps to the ir right after
+void eliminate_dead_code(Chunk& chunk);
+
+// Removes instructions without side effects whose result is never read.
+// Variables are kept for the debugger.
+void eliminate_dead_stores(Chunk& chunk);
+
+}
\ No newline at end of file
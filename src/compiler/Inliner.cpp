@@ -0,0 +1,235 @@
+#include "Inliner.hpp"
+
+#include "ControlFlowGraph.hpp"
+#include "Ir.hpp"
+#include "Liveness.hpp"
+#include "OpCode.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <vector>
+
+using CallGraph = std::map<std::string, std::set<std::string>>;
+
+static CallGraph build_call_graph(const std::map<std::string, jl::Chunk>& chunk_map)
+{
+    CallGraph graph;
+
+    for (const auto& [name, chunk] : chunk_map) {
+        auto& callees = graph[name];
+        for (const auto& ir : chunk.get_ir()) {
+            if (ir.type() == jl::Ir::CALL) {
+                callees.insert(ir.call().func_name);
+            }
+        }
+    }
+
+    return graph;
+}
+
+// Functions which can end up calling themselves
+static std::set<std::string> find_recursive(const CallGraph& graph)
+{
+    std::set<std::string> recursive;
+
+    for (const auto& [name, callees] : graph) {
+        std::set<std::string> visited;
+        std::vector<std::string> worklist(callees.begin(), callees.end());
+
+        while (!worklist.empty()) {
+            const auto callee = worklist.back();
+            worklist.pop_back();
+
+            if (callee == name) {
+                recursive.insert(name);
+                break;
+            }
+            if (!visited.insert(callee).second || !graph.contains(callee)) {
+                continue;
+            }
+
+            worklist.insert(worklist.end(), graph.at(callee).begin(), graph.at(callee).end());
+        }
+    }
+
+    return recursive;
+}
+
+// Callees come before their callers, so inlined bodies are already inlined
+static std::vector<std::string> bottom_up_order(const CallGraph& graph)
+{
+    std::vector<std::string> order;
+    std::set<std::string> visited;
+
+    const std::function<void(const std::string&)> visit = [&](const std::string& name) {
+        if (!visited.insert(name).second) {
+            return;
+        }
+        for (const auto& callee : graph.at(name)) {
+            if (graph.contains(callee)) {
+                visit(callee);
+            }
+        }
+        order.push_back(name);
+    };
+
+    for (const auto& [name, callees] : graph) {
+        visit(name);
+    }
+
+    return order;
+}
+
+// Copies the body of the callee with its temps and labels renamed into the
+// caller. Every RETURN moves its value into the destination of the call and
+// jumps to the end of the copied body.
+static void expand_call(
+    jl::Chunk& caller,
+    const jl::Chunk& callee,
+    const jl::CallIr& call,
+    uint32_t call_line,
+    std::vector<jl::Ir>& irs,
+    std::vector<uint32_t>& lines)
+{
+    using jl::Ir;
+    using jl::OpCode;
+    using jl::TempVar;
+
+    const auto& callee_irs = callee.get_ir();
+    const auto callee_lines = callee.get_lines();
+
+    // Parameters are only written to by the call, so the callee can read
+    // the arguments directly unless it assigns to the parameter
+    std::vector<bool> written(callee.get_max_allocated_temps(), false);
+    for (const auto& ir : callee_irs) {
+        if (const auto def = jl::get_def(ir)) {
+            written[*def] = true;
+        }
+    }
+
+    std::vector<uint32_t> temps(callee.get_max_allocated_temps());
+    for (uint32_t t = 0; t < temps.size(); t++) {
+        const bool is_param = t >= 1 && t <= call.args.size();
+
+        if (is_param && !written[t]) {
+            temps[t] = call.args[t - 1].idx;
+        } else {
+            temps[t] = caller.create_temp_var(callee.get_nested_type(TempVar { t })).idx;
+        }
+    }
+
+    for (uint32_t i = 0; i < call.args.size(); i++) {
+        const auto param = i + 1;
+        if (written[param]) {
+            irs.push_back(Ir { jl::UnaryIr { OpCode::MOVE, call.args[i], TempVar { temps[param] } } });
+            lines.push_back(call_line);
+        }
+    }
+
+    // A real call starts with a zeroed frame, but the renamed temps may
+    // still hold values from an earlier expansion, so temps read before
+    // they are written, like variables declared without a value, are
+    // cleared first
+    const auto liveness = compute_liveness(callee, build_cfg(callee));
+    for (uint32_t t = 0; t < temps.size(); t++) {
+        const bool is_param = t >= 1 && t <= call.args.size();
+        const bool is_function = std::ranges::any_of(callee.m_registered_functions, [&](const auto& func) {
+            return func.first == t;
+        });
+
+        if (!liveness.live_in.empty() && liveness.live_in[0][t] && !is_param && !is_function) {
+            irs.push_back(Ir { jl::UnaryIr { OpCode::MOVE, jl::Nil {}, TempVar { temps[t] } } });
+            lines.push_back(call_line);
+        }
+    }
+
+    std::vector<int> labels(callee.get_max_labels());
+    for (auto& label : labels) {
+        label = caller.create_new_label();
+    }
+    const auto end_label = caller.create_new_label();
+
+    for (uint32_t i = 0; i < callee_irs.size(); i++) {
+        auto ir = callee_irs[i];
+        const auto line = callee_lines[i];
+
+        if (ir.opcode() == OpCode::RETURN) {
+            auto value = ir.control().data;
+            if (jl::get_type(value) == jl::OperandType::TEMP) {
+                value = TempVar { temps[std::get<TempVar>(value).idx] };
+            }
+
+            if (jl::get_type(value) != jl::OperandType::NIL) {
+                irs.push_back(Ir { jl::UnaryIr { OpCode::MOVE, value, call.return_var } });
+                lines.push_back(line);
+            }
+
+            irs.push_back(Ir { jl::ControlIr { OpCode::JMP, end_label } });
+            lines.push_back(line);
+            continue;
+        }
+
+        jl::rename_temps(ir, [&](uint32_t t) { return temps[t]; });
+
+        if (ir.opcode() == OpCode::LABEL || ir.opcode() == OpCode::JMP) {
+            auto& data = std::get<jl::ControlIr>(ir.data).data;
+            data = labels[std::get<int>(data)];
+        } else if (ir.opcode() == OpCode::JMP_UNLESS) {
+            auto& target = std::get<jl::JumpIr>(ir.data).target;
+            target = labels[std::get<int>(target)];
+        }
+
+        irs.push_back(std::move(ir));
+        lines.push_back(line);
+    }
+
+    irs.push_back(Ir { jl::ControlIr { OpCode::LABEL, end_label } });
+    lines.push_back(call_line);
+}
+
+void jl::inline_functions(std::map<std::string, Chunk>& chunk_map, uint32_t max_size)
+{
+    const auto graph = build_call_graph(chunk_map);
+    const auto recursive = find_recursive(graph);
+
+    const auto can_inline = [&](const std::string& name) {
+        if (!chunk_map.contains(name) || recursive.contains(name)) {
+            return false;
+        }
+
+        const auto& callee = chunk_map.at(name);
+        return !callee.extern_symbol && callee.get_ir().size() <= max_size;
+    };
+
+    for (const auto& name : bottom_up_order(graph)) {
+        auto& caller = chunk_map.at(name);
+        if (caller.extern_symbol) {
+            continue;
+        }
+
+        const auto& caller_irs = caller.get_ir();
+        const auto caller_lines = caller.get_lines();
+        std::vector<Ir> irs;
+        std::vector<uint32_t> lines;
+        bool changed = false;
+
+        for (uint32_t i = 0; i < caller_irs.size(); i++) {
+            const auto& ir = caller_irs[i];
+
+            if (ir.type() == Ir::CALL && ir.call().func_name != name && can_inline(ir.call().func_name)) {
+                expand_call(caller, chunk_map.at(ir.call().func_name), ir.call(), caller_lines[i], irs, lines);
+                changed = true;
+            } else {
+                irs.push_back(ir);
+                lines.push_back(caller_lines[i]);
+            }
+        }
+
+        if (changed) {
+            caller.remove_ir(std::vector<bool>(caller_irs.size(), true));
+            caller.insert_ir(0, irs, lines);
+        }
+    }
+}
\ No newline at end of file
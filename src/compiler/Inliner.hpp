@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace jl {
+
+// Replaces calls to functions with at most `max_size` ir by a copy of their
+// body. Recursive and extern functions are never inlined.
+void inline_functions(std::map<std::string, Chunk>& chunk_map, uint32_t max_size);
+
+}
\ No newline at end of file
@@ -105,4 +105,114 @@ const jl::TempVar& jl::Ir::dest() const
         unimplemented();
     }
     return binary().dest;
+}
+
+std::vector<uint32_t> jl::get_uses(const Ir& ir)
+{
+    std::vector<uint32_t> uses;
+
+    const auto add_operand = [&](const Operand& operand) {
+        if (get_type(operand) == OperandType::TEMP) {
+            uses.push_back(std::get<TempVar>(operand).idx);
+        }
+    };
+
+    switch (ir.type()) {
+    case Ir::UNARY:
+        add_operand(ir.unary().operand);
+        break;
+    case Ir::BINARY:
+        uses.push_back(ir.binary().op1.idx);
+        uses.push_back(ir.binary().op2.idx);
+        break;
+    case Ir::CONTROL:
+        add_operand(ir.control().data);
+        break;
+    case Ir::JUMP_STORE:
+        uses.push_back(ir.jump().data.idx);
+        add_operand(ir.jump().target);
+        break;
+    case Ir::CALL:
+        uses.push_back(ir.call().func_var.idx);
+        for (const auto& arg : ir.call().args) {
+            uses.push_back(arg.idx);
+        }
+        break;
+    case Ir::TYPE_CAST:
+        uses.push_back(ir.cast().source.idx);
+        break;
+    case Ir::LOAD_STORE:
+        uses.push_back(ir.load_store().addr.idx);
+        if (ir.load_store().opcode == OpCode::STORE) {
+            uses.push_back(ir.load_store().reg.idx);
+        }
+        break;
+    }
+
+    return uses;
+}
+
+std::optional<uint32_t> jl::get_def(const Ir& ir)
+{
+    switch (ir.type()) {
+    case Ir::UNARY:
+    case Ir::BINARY:
+    case Ir::CALL:
+    case Ir::TYPE_CAST:
+        return ir.dest().idx;
+    case Ir::LOAD_STORE:
+        if (ir.load_store().opcode == OpCode::LOAD) {
+            return ir.load_store().reg.idx;
+        }
+        return std::nullopt;
+    case Ir::CONTROL:
+    case Ir::JUMP_STORE:
+        return std::nullopt;
+    }
+
+    return std::nullopt;
+}
+
+void jl::rename_temps(Ir& ir, const std::function<uint32_t(uint32_t)>& rename)
+{
+    const auto rename_var = [&](TempVar& var) {
+        var.idx = rename(var.idx);
+    };
+
+    const auto rename_operand = [&](Operand& operand) {
+        if (get_type(operand) == OperandType::TEMP) {
+            rename_var(std::get<TempVar>(operand));
+        }
+    };
+
+    std::visit([&](auto& data) {
+        using T = std::decay_t<decltype(data)>;
+
+        if constexpr (std::is_same_v<T, UnaryIr>) {
+            rename_operand(data.operand);
+            rename_var(data.dest);
+        } else if constexpr (std::is_same_v<T, BinaryIr>) {
+            rename_var(data.op1);
+            rename_var(data.op2);
+            rename_var(data.dest);
+        } else if constexpr (std::is_same_v<T, ControlIr>) {
+            rename_operand(data.data);
+        } else if constexpr (std::is_same_v<T, JumpIr>) {
+            rename_var(data.data);
+            rename_operand(data.target);
+        } else if constexpr (std::is_same_v<T, CallIr>) {
+            rename_var(data.func_var);
+            for (auto& arg : data.args) {
+                rename_var(arg);
+            }
+            rename_var(data.return_var);
+        } else if constexpr (std::is_same_v<T, TypeCastIr>) {
+            rename_var(data.source);
+            rename_var(data.dest);
+        } else if constexpr (std::is_same_v<T, LoadStoreIr>) {
+            rename_var(data.addr);
+            rename_var(data.reg);
+        }
+    },
+        ir.data);
 }
\ No newline at end of file
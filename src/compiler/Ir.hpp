@@ -4,6 +4,7 @@
 #include "Operand.hpp"
 
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <string>
 #include <variant>
@@ -87,4 +88,11 @@ struct Ir {
 
 Ir::Type get_type(const Ir& ir);
 
+// Temp vars read by the instruction
+std::vector<uint32_t> get_uses(const Ir& ir);
+// Temp var written by the instruction
+std::optional<uint32_t> get_def(const Ir& ir);
+// Replaces every temp var in the instruction with the one returned by rename
+void rename_temps(Ir& ir, const std::function<uint32_t(uint32_t)>& rename);
+
 }
\ No newline at end of file
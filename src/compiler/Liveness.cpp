@@ -0,0 +1,63 @@
+#include "Liveness.hpp"
+
+#include "Ir.hpp"
+
+jl::Liveness jl::compute_liveness(const Chunk& chunk, const ControlFlowGraph& cfg)
+{
+    const auto& irs = chunk.get_ir();
+    const auto temps = chunk.get_max_allocated_temps();
+    const auto block_count = cfg.blocks.size();
+
+    // Temps read before being written in the block and temps written in it
+    std::vector<std::vector<bool>> uses(block_count, std::vector<bool>(temps, false));
+    std::vector<std::vector<bool>> defs(block_count, std::vector<bool>(temps, false));
+
+    for (uint32_t b = 0; b < block_count; b++) {
+        for (uint32_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            for (const auto use : get_uses(irs[i])) {
+                if (!defs[b][use]) {
+                    uses[b][use] = true;
+                }
+            }
+
+            if (const auto def = get_def(irs[i])) {
+                defs[b][*def] = true;
+            }
+        }
+    }
+
+    Liveness liveness {
+        .live_in = uses,
+        .live_out = std::vector<std::vector<bool>>(block_count, std::vector<bool>(temps, false)),
+    };
+
+    // Propagate backwards until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (int b = block_count - 1; b >= 0; b--) {
+            auto& live_out = liveness.live_out[b];
+            auto& live_in = liveness.live_in[b];
+
+            for (const auto succ : cfg.blocks[b].successors) {
+                const auto& succ_in = liveness.live_in[succ];
+                for (uint32_t t = 0; t < temps; t++) {
+                    if (succ_in[t] && !live_out[t]) {
+                        live_out[t] = true;
+                        changed = true;
+                    }
+                }
+            }
+
+            for (uint32_t t = 0; t < temps; t++) {
+                if (live_out[t] && !defs[b][t] && !live_in[t]) {
+                    live_in[t] = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    return liveness;
+}
\ No newline at end of file
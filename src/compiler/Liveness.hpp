@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include "Chunk.hpp"
+#include "ControlFlowGraph.hpp"
+
+namespace jl {
+
+// Temp vars live at the entry and exit of every basic block
+struct Liveness {
+    std::vector<std::vector<bool>> live_in;
+    std::vector<std::vector<bool>> live_out;
+};
+
+Liveness compute_liveness(const Chunk& chunk, const ControlFlowGraph& cfg);
+
+}
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "LoopInvariantCodeMotion.hpp"
+
+#include "ControlFlowGraph.hpp"
+#include "Ir.hpp"
+#include "Liveness.hpp"
+#include "OpCode.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Ir which only writes its destination and can not fault, so running it
+// before the loop is safe even when the loop body never runs
+static bool is_hoistable(const jl::Ir& ir)
+{
+    switch (ir.type()) {
+    case jl::Ir::UNARY:
+    case jl::Ir::TYPE_CAST:
+        return true;
+    case jl::Ir::BINARY: {
+        const auto& bin = ir.binary();
+        const bool divides = bin.opcode == jl::OpCode::SLASH || bin.opcode == jl::OpCode::MODULUS;
+        return !(divides && bin.type != jl::OperandType::FLOAT);
+    }
+    default:
+        return false;
+    }
+}
+
+static bool is_jump_to(const jl::Ir& ir, int label)
+{
+    if (ir.opcode() == jl::OpCode::JMP) {
+        return std::get<int>(ir.control().data) == label;
+    } else if (ir.opcode() == jl::OpCode::JMP_UNLESS) {
+        return std::get<int>(ir.jump().target) == label;
+    }
+
+    return false;
+}
+
+static void retarget_jump(jl::Ir& ir, int label)
+{
+    if (ir.opcode() == jl::OpCode::JMP) {
+        std::get<jl::ControlIr>(ir.data).data = label;
+    } else {
+        std::get<jl::JumpIr>(ir.data).target = label;
+    }
+}
+
+static bool hoist_from_loop(jl::Chunk& chunk, const jl::ControlFlowGraph& cfg, const jl::Liveness& liveness, const jl::Loop& loop)
+{
+    auto& irs = chunk.get_ir_mut();
+    const auto temps = chunk.get_max_allocated_temps();
+    const auto& header = cfg.blocks[loop.header];
+
+    std::vector<bool> in_loop(cfg.blocks.size(), false);
+    for (const auto b : loop.blocks) {
+        in_loop[b] = true;
+    }
+
+    // The hoisted ir is placed right before the label of the header, which
+    // must not be reached by falling through from inside the loop
+    if (irs[header.begin].opcode() != jl::OpCode::LABEL) {
+        return false;
+    }
+    if (header.begin > 0 && in_loop[cfg.block_of[header.begin - 1]]) {
+        const auto last = irs[header.begin - 1].opcode();
+        if (last != jl::OpCode::JMP && last != jl::OpCode::RETURN && last != jl::OpCode::HALT) {
+            return false;
+        }
+    }
+
+    std::vector<uint32_t> def_count(temps, 0);
+    for (const auto b : loop.blocks) {
+        for (uint32_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+            if (const auto def = jl::get_def(irs[i])) {
+                def_count[*def]++;
+            }
+        }
+    }
+
+    // Blocks leaving the loop and the blocks outside they lead to
+    std::vector<uint32_t> exiting;
+    std::vector<uint32_t> exits;
+    for (const auto b : loop.blocks) {
+        for (const auto succ : cfg.blocks[b].successors) {
+            if (!in_loop[succ]) {
+                exiting.push_back(b);
+                exits.push_back(succ);
+            }
+        }
+    }
+
+    std::vector<bool> hoisted_def(temps, false);
+    std::vector<bool> hoisted(irs.size(), false);
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (const auto b : loop.blocks) {
+            for (uint32_t i = cfg.blocks[b].begin; i < cfg.blocks[b].end; i++) {
+                const auto& ir = irs[i];
+                const auto def = jl::get_def(ir);
+
+                if (hoisted[i] || !def || !is_hoistable(ir)) {
+                    continue;
+                }
+
+                // The temp must hold only this value inside the loop
+                const auto temp = *def;
+                if (chunk.is_variable(temp) || def_count[temp] != 1 || liveness.live_in[loop.header][temp]) {
+                    continue;
+                }
+
+                const auto uses = jl::get_uses(ir);
+                const bool invariant = std::ranges::all_of(uses, [&](uint32_t use) {
+                    return def_count[use] == 0 || hoisted_def[use];
+                });
+                if (!invariant) {
+                    continue;
+                }
+
+                // Running it when the loop would not have is only fine if
+                // nothing after the loop reads the result
+                const bool always_runs = std::ranges::all_of(exiting, [&](uint32_t exit) {
+                    return cfg.dominates(b, exit);
+                });
+                const bool dead_after_loop = std::ranges::none_of(exits, [&](uint32_t exit) {
+                    return liveness.live_in[exit][temp];
+                });
+                if (!always_runs && !dead_after_loop) {
+                    continue;
+                }
+
+                hoisted[i] = true;
+                hoisted_def[temp] = true;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<jl::Ir> moved;
+    std::vector<uint32_t> moved_lines;
+    const auto lines = chunk.get_lines();
+    uint32_t position = header.begin;
+
+    for (uint32_t i = 0; i < irs.size(); i++) {
+        if (hoisted[i]) {
+            moved.push_back(irs[i]);
+            moved_lines.push_back(lines[i]);
+            if (i < header.begin) {
+                position--;
+            }
+        }
+    }
+
+    if (moved.empty()) {
+        return false;
+    }
+
+    // Jumps into the loop from outside go through the hoisted ir, so they
+    // get a new label in front of it. The back edges keep the old one.
+    const auto header_label = std::get<int>(irs[header.begin].control().data);
+    bool jumped_to = false;
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        auto& last = irs[cfg.blocks[b].end - 1];
+        if (!in_loop[b] && is_jump_to(last, header_label)) {
+            jumped_to = true;
+        }
+    }
+
+    if (jumped_to) {
+        const auto preheader_label = chunk.create_new_label();
+
+        for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+            auto& last = irs[cfg.blocks[b].end - 1];
+            if (!in_loop[b] && is_jump_to(last, header_label)) {
+                retarget_jump(last, preheader_label);
+            }
+        }
+
+        moved.insert(moved.begin(), jl::Ir { jl::ControlIr { jl::OpCode::LABEL, preheader_label } });
+        moved_lines.insert(moved_lines.begin(), lines[header.begin]);
+    }
+
+    chunk.remove_ir(hoisted);
+    chunk.insert_ir(position, moved, moved_lines);
+
+    return true;
+}
+
+static bool hoist_once(jl::Chunk& chunk)
+{
+    const auto cfg = jl::build_cfg(chunk);
+    const auto liveness = jl::compute_liveness(chunk, cfg);
+
+    // Inner loops first, what they hoist may be invariant in the outer loop
+    for (auto loop = cfg.loops.rbegin(); loop != cfg.loops.rend(); loop++) {
+        if (hoist_from_loop(chunk, cfg, liveness, *loop)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void jl::hoist_loop_invariants(Chunk& chunk)
+{
+    while (hoist_once(chunk)) { }
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+namespace jl {
+
+// Moves ir whose operands do not change inside a loop in front of the loop,
+// so it runs once instead of on every iteration
+void hoist_loop_invariants(Chunk& chunk);
+
+}
\ No newline at end of file
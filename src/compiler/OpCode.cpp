@@ -48,6 +48,8 @@ const char* jl::to_string(OpCode opcode)
         return "POP";
     case jl::OpCode::CALL:
         return "CALL";
+    case jl::OpCode::MAP:
+        return "MAP";
     case jl::OpCode::HALT:
         return "HALT";
     case OpCode::LOAD:
@@ -102,6 +104,7 @@ jl::OperatorCategory jl::get_category(const OpCode& opcode)
     case jl::OpCode::PUSH:
     case jl::OpCode::POP:
     case jl::OpCode::CALL:
+    case jl::OpCode::MAP:
     case jl::OpCode::HALT:
     case jl::OpCode::LOAD:
     case jl::OpCode::STORE:
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstdint>
+
 namespace jl {
 
-enum class OpCode {
+enum class OpCode : uint8_t {
     ADD,
     MINUS,
     STAR,
@@ -30,6 +32,7 @@ enum class OpCode {
     PUSH,
     POP,
     CALL,
+    MAP, // Calls an extern for every element of arrays
     LOAD,
     STORE,
     TYPE_CAST,
@@ -9,7 +9,7 @@
 
 namespace jl {
 
-enum class OperandType {
+enum class OperandType : uint8_t {
     INT,
     FLOAT,
     TEMP,
@@ -0,0 +1,46 @@
+#include "Optimizer.hpp"
+
+#include "ConstantFolding.hpp"
+#include "DeadCodeElimination.hpp"
+#include "Inliner.hpp"
+#include "LoopInvariantCodeMotion.hpp"
+#include "RegisterAllocation.hpp"
+#include "TailCalls.hpp"
+
+void jl::optimize(std::map<std::string, Chunk>& chunk_map, const OptimizerOptions& options)
+{
+    // A function calling itself only in tail position is no longer
+    // recursive afterwards, which lets the inliner take it
+    if (options.eliminate_tail_calls) {
+        for (auto& [name, chunk] : chunk_map) {
+            eliminate_tail_calls(chunk);
+        }
+    }
+
+    if (options.inline_functions) {
+        inline_functions(chunk_map, options.inline_threshold);
+    }
+
+    for (auto& [name, chunk] : chunk_map) {
+        if (chunk.extern_symbol) {
+            continue;
+        }
+
+        if (options.fold_constants) {
+            fold_constants(chunk);
+        }
+
+        if (options.eliminate_dead_code) {
+            eliminate_dead_code(chunk);
+            eliminate_dead_stores(chunk);
+        }
+
+        if (options.hoist_loop_invariants) {
+            hoist_loop_invariants(chunk);
+        }
+
+        if (options.allocate_registers) {
+            allocate_registers(chunk);
+        }
+    }
+}
\ No newline at end of file
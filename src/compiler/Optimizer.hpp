@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace jl {
+
+struct OptimizerOptions {
+    bool eliminate_tail_calls { true };
+    bool inline_functions { true };
+    // Functions with at most this many ir are inlined
+    uint32_t inline_threshold { 32 };
+    bool fold_constants { true };
+    bool eliminate_dead_code { true };
+    bool hoist_loop_invariants { true };
+    bool allocate_registers { true };
+};
+
+// Runs the IR passes over every chunk, between code generation and lowering
+void optimize(std::map<std::string, Chunk>& chunk_map, const OptimizerOptions& options = {});
+
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include "Program.hpp"
+
+#include <algorithm>
+
+jl::Program::Program(const std::map<std::string, Chunk>& chunk_map, const DataSection& data_section)
+{
+    const auto function_ids = assign_function_ids(chunk_map);
+    m_code = lower_all(chunk_map, function_ids);
+    m_root_id = function_ids.at("__root__");
+
+    const auto* data = static_cast<const uint8_t*>(data_section.data());
+    m_data.assign(data, data + data_section.size());
+
+    resolve_externs();
+}
+
+jl::Program::Program(std::vector<BytecodeChunk> code, uint32_t root_id, std::span<const uint8_t> data)
+    : m_code(std::move(code))
+    , m_root_id(root_id)
+    , m_data(data.begin(), data.end())
+{
+    resolve_externs();
+}
+
+void jl::Program::resolve_externs()
+{
+    // The bytecode points into m_externs, so it must never reallocate
+    const auto extern_count = std::ranges::count_if(m_code, [](const BytecodeChunk& bc) {
+        return bc.extern_symbol && !bc.is_variadic;
+    });
+    m_externs.reserve(extern_count);
+
+    for (auto& bc : m_code) {
+        if (bc.extern_symbol && !bc.is_variadic) {
+            bc.extern_func = &m_externs.emplace_back(CFFI::instance().prepare(
+                *bc.extern_symbol,
+                bc.extern_library,
+                bc.param_types,
+                bc.return_type));
+        }
+    }
+
+    for (auto& bc : m_code) {
+        for (uint32_t i = 0; i < bc.call_sites.size(); i++) {
+            const auto& site = bc.call_sites[i];
+            const auto& callee = m_code[site.func_id];
+
+            if (!callee.is_variadic) {
+                continue;
+            }
+
+            const auto types_begin = bc.call_arg_types.begin() + site.args_offset;
+            std::vector<OperandType> arg_types(types_begin, types_begin + site.arg_count);
+            auto it = m_variadic_externs.find({ site.func_id, arg_types });
+
+            if (it == m_variadic_externs.end()) {
+                auto func = CFFI::instance().prepare_variadic(
+                    *callee.extern_symbol,
+                    callee.extern_library,
+                    arg_types,
+                    callee.param_types.size(),
+                    callee.return_type);
+                it = m_variadic_externs.emplace(std::pair { site.func_id, std::move(arg_types) }, std::move(func)).first;
+            }
+
+            bc.variadic_calls.resize(bc.call_sites.size(), nullptr);
+            bc.variadic_calls[i] = &it->second;
+        }
+    }
+}
+
+const std::vector<jl::BytecodeChunk>& jl::Program::code() const
+{
+    return m_code;
+}
+
+uint32_t jl::Program::root_id() const
+{
+    return m_root_id;
+}
+
+std::span<const uint8_t> jl::Program::data() const
+{
+    return m_data;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "CFFI.hpp"
+#include "Chunk.hpp"
+#include "DataSection.hpp"
+
+namespace jl {
+
+// A compiled program, which is never modified once created. Any number of
+// VMs, on any thread, can run the same program at the same time, each one
+// with its own registers and its own copy of the data section.
+class Program {
+public:
+    Program(const std::map<std::string, Chunk>& chunk_map, const DataSection& data_section);
+    // Takes bytecode indexed by function id, like the bytecode of a .junec file
+    Program(std::vector<BytecodeChunk> code, uint32_t root_id, std::span<const uint8_t> data);
+
+    Program(const Program&) = delete;
+    Program(Program&&) = delete;
+    Program& operator=(const Program&) = delete;
+    Program& operator=(Program&&) = delete;
+
+    const std::vector<BytecodeChunk>& code() const;
+    uint32_t root_id() const;
+    // Contents of the data section before the program runs
+    std::span<const uint8_t> data() const;
+
+private:
+    std::vector<BytecodeChunk> m_code;
+    uint32_t m_root_id;
+    std::vector<uint8_t> m_data;
+    // Every extern prepared once, pointed to by the bytecode of its chunk
+    std::vector<CFFI::Function> m_externs;
+    // Variadic externs prepared once for every list of argument types
+    // they are called with, pointed to by the bytecode of the callers
+    std::map<std::pair<uint32_t, std::vector<OperandType>>, CFFI::Function> m_variadic_externs;
+
+    void resolve_externs();
+};
+
+}
\ No newline at end of file
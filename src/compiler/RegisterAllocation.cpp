@@ -0,0 +1,123 @@
+#include "RegisterAllocation.hpp"
+
+#include "ControlFlowGraph.hpp"
+#include "Ir.hpp"
+#include "Liveness.hpp"
+#include "Operand.hpp"
+#include "VariableManager.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace {
+
+struct Interval {
+    uint32_t temp;
+    uint32_t start { UINT32_MAX };
+    uint32_t end { 0 };
+
+    void extend(uint32_t point)
+    {
+        start = std::min(start, point);
+        end = std::max(end, point);
+    }
+
+    bool empty() const
+    {
+        return start > end;
+    }
+};
+
+}
+
+// The range of ir over which every temp may hold a value. Treating it as a
+// single range is conservative for temps live across a loop back edge.
+static std::vector<Interval> build_intervals(const jl::Chunk& chunk)
+{
+    const auto& irs = chunk.get_ir();
+    const auto temps = chunk.get_max_allocated_temps();
+    const auto cfg = jl::build_cfg(chunk);
+    const auto liveness = jl::compute_liveness(chunk, cfg);
+
+    std::vector<Interval> intervals(temps);
+    for (uint32_t t = 0; t < temps; t++) {
+        intervals[t].temp = t;
+    }
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        const auto& block = cfg.blocks[b];
+
+        for (uint32_t t = 0; t < temps; t++) {
+            if (liveness.live_in[b][t]) {
+                intervals[t].extend(block.begin);
+            }
+            if (liveness.live_out[b][t]) {
+                intervals[t].extend(block.end - 1);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < irs.size(); i++) {
+        for (const auto use : jl::get_uses(irs[i])) {
+            intervals[use].extend(i);
+        }
+
+        if (const auto def = jl::get_def(irs[i])) {
+            intervals[*def].extend(i);
+        }
+    }
+
+    return intervals;
+}
+
+void jl::allocate_registers(Chunk& chunk)
+{
+    const auto temps = chunk.get_max_allocated_temps();
+    auto intervals = build_intervals(chunk);
+
+    std::vector<uint32_t> new_index(temps, VariableManager::dropped_temp);
+    uint32_t new_count = 0;
+
+    // Variables come first and in order, so the function itself and its
+    // parameters stay in the slots the VM passes arguments in
+    for (uint32_t t = 0; t < temps; t++) {
+        if (chunk.is_variable(t)) {
+            new_index[t] = new_count++;
+        }
+    }
+
+    std::erase_if(intervals, [&](const Interval& interval) {
+        return interval.empty() || chunk.is_variable(interval.temp);
+    });
+    std::ranges::sort(intervals, {}, &Interval::start);
+
+    // Slots are only shared between temps of the same type so that every
+    // slot still has a single type in the debug output
+    std::map<OperandType, std::vector<uint32_t>> free_slots;
+    std::vector<const Interval*> active;
+
+    for (const auto& interval : intervals) {
+        std::erase_if(active, [&](const Interval* other) {
+            if (other->end < interval.start) {
+                const auto slot = new_index[other->temp];
+                free_slots[chunk.get_nested_type(TempVar { other->temp })].push_back(slot);
+                return true;
+            }
+            return false;
+        });
+
+        auto& pool = free_slots[chunk.get_nested_type(TempVar { interval.temp })];
+        if (pool.empty()) {
+            new_index[interval.temp] = new_count++;
+        } else {
+            new_index[interval.temp] = pool.back();
+            pool.pop_back();
+        }
+
+        active.push_back(&interval);
+    }
+
+    chunk.remap_temps(new_index, new_count);
+}
\ No newline at end of file
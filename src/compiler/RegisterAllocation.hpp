@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+namespace jl {
+
+// Linear scan over the live ranges of the temp vars in the chunk. Temps that
+// are never live at the same time share a slot so the frame only grows with
+// the live set. Variables keep their own slot for the debugger.
+void allocate_registers(Chunk& chunk);
+
+}
\ No newline at end of file
@@ -0,0 +1,340 @@
+#include "Superinstructions.hpp"
+
+#include <optional>
+#include <vector>
+
+// Calls `func` with every register read by an unfused instruction
+template <typename Func>
+static void for_each_read(const jl::BytecodeChunk& bc, const jl::Instruction& ins, Func func)
+{
+    using jl::Op;
+
+    switch (ins.op) {
+    case Op::MOVE_CONST:
+    case Op::MOVE_DATA:
+    case Op::JMP:
+    case Op::RETURN_CONST:
+    case Op::RETURN_DATA:
+    case Op::HALT:
+        break;
+    case Op::MOVE:
+    case Op::NOT:
+    case Op::BIT_NOT:
+    case Op::INT_TO_FLOAT:
+    case Op::FLOAT_TO_INT:
+    case Op::INT_TO_CHAR:
+    case Op::CHAR_TO_INT:
+    case Op::FLOAT_TO_CHAR:
+    case Op::CHAR_TO_FLOAT:
+    case Op::LOAD_8:
+    case Op::LOAD_32:
+    case Op::LOAD_64:
+    case Op::JMP_UNLESS:
+    case Op::RETURN:
+        func(ins.b);
+        break;
+    case Op::STORE_8:
+    case Op::STORE_32:
+    case Op::STORE_64:
+        func(ins.a);
+        func(ins.b);
+        break;
+    case Op::CALL:
+    case Op::MAP_EXTERN: {
+        const auto& site = bc.call_sites[ins.b];
+        for (uint32_t i = 0; i < site.arg_count; i++) {
+            func(bc.call_args[site.args_offset + i]);
+        }
+        if (ins.op == Op::MAP_EXTERN) {
+            func(ins.c);
+        }
+    } break;
+    default:
+        // Binary operations
+        func(ins.b);
+        func(ins.c);
+        break;
+    }
+}
+
+static bool is_jump(jl::Op op)
+{
+    using jl::Op;
+
+    switch (op) {
+    case Op::JMP:
+    case Op::JMP_UNLESS:
+#define JL_CMP_JUMP(CMP)              \
+    case Op::JMP_UNLESS_##CMP##_INT: \
+    case Op::JMP_UNLESS_##CMP##_INT_CONST:
+        JL_CMP_JUMP(LESS)
+        JL_CMP_JUMP(LESS_EQUAL)
+        JL_CMP_JUMP(GREATER)
+        JL_CMP_JUMP(GREATER_EQUAL)
+        JL_CMP_JUMP(EQUAL)
+        JL_CMP_JUMP(NOT_EQUAL)
+#undef JL_CMP_JUMP
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool writes_register(jl::Op op)
+{
+    using jl::Op;
+
+    if (is_jump(op)) {
+        return false;
+    }
+
+    switch (op) {
+    case Op::RETURN:
+    case Op::RETURN_CONST:
+    case Op::RETURN_DATA:
+    case Op::STORE_8:
+    case Op::STORE_32:
+    case Op::STORE_64:
+    case Op::STORE_INDEXED_8:
+    case Op::STORE_INDEXED_32:
+    case Op::STORE_INDEXED_64:
+    case Op::MAP_EXTERN:
+    case Op::HALT:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Compare and branch with both operands in registers and with a constant
+static std::optional<std::pair<jl::Op, jl::Op>> select_branch_op(jl::Op cmp)
+{
+    using jl::Op;
+
+    switch (cmp) {
+    case Op::LESS_INT:
+        return { { Op::JMP_UNLESS_LESS_INT, Op::JMP_UNLESS_LESS_INT_CONST } };
+    case Op::LESS_EQUAL_INT:
+        return { { Op::JMP_UNLESS_LESS_EQUAL_INT, Op::JMP_UNLESS_LESS_EQUAL_INT_CONST } };
+    case Op::GREATER_INT:
+        return { { Op::JMP_UNLESS_GREATER_INT, Op::JMP_UNLESS_GREATER_INT_CONST } };
+    case Op::GREATER_EQUAL_INT:
+        return { { Op::JMP_UNLESS_GREATER_EQUAL_INT, Op::JMP_UNLESS_GREATER_EQUAL_INT_CONST } };
+    case Op::EQUAL_INT:
+        return { { Op::JMP_UNLESS_EQUAL_INT, Op::JMP_UNLESS_EQUAL_INT_CONST } };
+    case Op::NOT_EQUAL_INT:
+        return { { Op::JMP_UNLESS_NOT_EQUAL_INT, Op::JMP_UNLESS_NOT_EQUAL_INT_CONST } };
+    default:
+        return std::nullopt;
+    }
+}
+
+static std::optional<jl::Op> select_indexed_op(jl::Op offset, jl::Op access)
+{
+    using jl::Op;
+
+    if (offset == Op::ADD_PTR_8 && access == Op::LOAD_8)
+        return Op::LOAD_INDEXED_8;
+    if (offset == Op::ADD_PTR_32 && access == Op::LOAD_32)
+        return Op::LOAD_INDEXED_32;
+    if (offset == Op::ADD_PTR_64 && access == Op::LOAD_64)
+        return Op::LOAD_INDEXED_64;
+    if (offset == Op::ADD_PTR_8 && access == Op::STORE_8)
+        return Op::STORE_INDEXED_8;
+    if (offset == Op::ADD_PTR_32 && access == Op::STORE_32)
+        return Op::STORE_INDEXED_32;
+    if (offset == Op::ADD_PTR_64 && access == Op::STORE_64)
+        return Op::STORE_INDEXED_64;
+
+    return std::nullopt;
+}
+
+// Registers whose value may still be read after each instruction
+static std::vector<std::vector<bool>> compute_live_out(const jl::BytecodeChunk& bc)
+{
+    using jl::Op;
+
+    const auto& code = bc.code;
+    const auto size = code.size();
+    std::vector<std::vector<bool>> live_in(size, std::vector<bool>(bc.frame_size, false));
+    std::vector<std::vector<bool>> live_out(size, std::vector<bool>(bc.frame_size, false));
+
+    const auto successors = [&](size_t i) -> std::vector<size_t> {
+        switch (code[i].op) {
+        case Op::JMP:
+            return { code[i].a };
+        case Op::JMP_UNLESS:
+            return { code[i].a, i + 1 };
+        case Op::RETURN:
+        case Op::RETURN_CONST:
+        case Op::RETURN_DATA:
+        case Op::HALT:
+            return {};
+        default:
+            return { i + 1 };
+        }
+    };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (size_t i = size; i-- > 0;) {
+            auto out = std::vector<bool>(bc.frame_size, false);
+            for (const auto succ : successors(i)) {
+                if (succ >= size) {
+                    continue;
+                }
+                for (uint32_t reg = 0; reg < bc.frame_size; reg++) {
+                    out[reg] = out[reg] || live_in[succ][reg];
+                }
+            }
+
+            auto in = out;
+            if (writes_register(code[i].op)) {
+                in[code[i].a] = false;
+            }
+            for_each_read(bc, code[i], [&](uint32_t reg) { in[reg] = true; });
+
+            if (in != live_in[i] || out != live_out[i]) {
+                live_in[i] = std::move(in);
+                live_out[i] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+
+    return live_out;
+}
+
+void jl::fuse_superinstructions(BytecodeChunk& bc)
+{
+    const auto& code = bc.code;
+    const auto size = code.size();
+
+    // Registers are shared between temps, so whether a value is read again
+    // is decided by liveness rather than by counting reads of the register
+    const auto live_out = compute_live_out(bc);
+
+    // Variables are read back after the chunk has run
+    std::vector<bool> pinned(bc.frame_size, false);
+    for (const auto& [name, reg] : bc.source->get_variable_map()) {
+        pinned[reg] = true;
+    }
+
+    // The value in `reg` is not needed after the instruction `consumer`
+    const auto dead_after = [&](uint32_t reg, size_t consumer) {
+        const auto& ins = code[consumer];
+        const bool redefined = writes_register(ins.op) && ins.a == reg;
+        return !pinned[reg] && (redefined || !live_out[consumer][reg]);
+    };
+
+    // Instructions which are jumped to can not be fused into the one before
+    std::vector<bool> is_target(size + 1, false);
+    for (const auto& ins : code) {
+        if (is_jump(ins.op)) {
+            is_target[ins.a] = true;
+        }
+    }
+
+    const auto fusable = [&](size_t i, size_t count) {
+        if (i + count > size) {
+            return false;
+        }
+
+        for (size_t j = i + 1; j < i + count; j++) {
+            if (is_target[j]) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    std::vector<Instruction> fused;
+    std::vector<uint32_t> origins;
+    std::vector<uint32_t> remap(size + 1);
+    fused.reserve(size);
+    origins.reserve(size);
+
+    size_t i = 0;
+    while (i < size) {
+        const auto& ins = code[i];
+        auto out = ins;
+        size_t count = 1;
+
+        if (fusable(i, 3) && ins.op == Op::MOVE_CONST
+            && select_branch_op(code[i + 1].op)
+            && code[i + 2].op == Op::JMP_UNLESS
+            && code[i + 1].c == ins.a && code[i + 1].b != ins.a && dead_after(ins.a, i + 1)
+            && code[i + 2].b == code[i + 1].a && dead_after(code[i + 1].a, i + 2)) {
+            // MOVE_CONST k, C; LESS_INT t, x, k; JMP_UNLESS L, t
+            out = Instruction {
+                .op = select_branch_op(code[i + 1].op)->second,
+                .a = code[i + 2].a,
+                .b = code[i + 1].b,
+                .c = ins.b,
+            };
+            count = 3;
+        } else if (fusable(i, 2) && select_branch_op(ins.op)
+            && code[i + 1].op == Op::JMP_UNLESS
+            && code[i + 1].b == ins.a && dead_after(ins.a, i + 1)) {
+            // LESS_INT t, x, y; JMP_UNLESS L, t
+            out = Instruction {
+                .op = select_branch_op(ins.op)->first,
+                .a = code[i + 1].a,
+                .b = ins.b,
+                .c = ins.c,
+            };
+            count = 2;
+        } else if (fusable(i, 2) && ins.op == Op::MOVE_CONST
+            && (code[i + 1].op == Op::ADD_INT || code[i + 1].op == Op::SUB_INT)
+            && code[i + 1].c == ins.a && code[i + 1].b != ins.a && dead_after(ins.a, i + 1)) {
+            // MOVE_CONST k, C; ADD_INT d, x, k
+            out = Instruction {
+                .op = code[i + 1].op == Op::ADD_INT ? Op::ADD_INT_CONST : Op::SUB_INT_CONST,
+                .a = code[i + 1].a,
+                .b = code[i + 1].b,
+                .c = ins.b,
+            };
+            count = 2;
+        } else if (fusable(i, 2) && select_indexed_op(ins.op, code[i + 1].op)
+            && code[i + 1].b == ins.a && code[i + 1].a != ins.a && dead_after(ins.a, i + 1)) {
+            // ADD_PTR_32 p, ptr, idx; LOAD_32 r, p (or STORE_32 r, p)
+            out = Instruction {
+                .op = *select_indexed_op(ins.op, code[i + 1].op),
+                .a = code[i + 1].a,
+                .b = ins.b,
+                .c = ins.c,
+            };
+            count = 2;
+        } else if (ins.op == Op::MOVE && i > 0 && !is_target[i] && !fused.empty()
+            && writes_register(fused.back().op) && fused.back().a == ins.b
+            && dead_after(ins.b, i)) {
+            // ADD_INT d, x, y; MOVE v, d
+            // The previous instruction writes straight into the destination
+            fused.back().a = ins.a;
+            remap[i] = fused.size() - 1;
+            i++;
+            continue;
+        }
+
+        for (size_t j = i; j < i + count; j++) {
+            remap[j] = fused.size();
+        }
+
+        fused.push_back(out);
+        origins.push_back(bc.origins[i]);
+        i += count;
+    }
+    remap[size] = fused.size();
+
+    for (auto& ins : fused) {
+        if (is_jump(ins.op)) {
+            ins.a = remap[ins.a];
+        }
+    }
+
+    bc.code = std::move(fused);
+    bc.origins = std::move(origins);
+}
\ No newline at end of file
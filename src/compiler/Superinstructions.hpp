@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Bytecode.hpp"
+
+namespace jl {
+
+// Replaces common instruction sequences with a single instruction that does
+// the same work. Must run after jump targets are resolved.
+void fuse_superinstructions(BytecodeChunk& bc);
+
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "TailCalls.hpp"
+
+#include "ControlFlowGraph.hpp"
+#include "Ir.hpp"
+#include "Liveness.hpp"
+#include "OpCode.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Index of the RETURN the ir after `i` falls through to, following labels
+// and unconditional jumps, if nothing else runs on the way
+static std::optional<uint32_t> find_return(const jl::Chunk& chunk, const std::vector<uint32_t>& labels, uint32_t i)
+{
+    const auto& irs = chunk.get_ir();
+    std::vector<bool> visited(irs.size(), false);
+
+    for (auto j = i + 1; j < irs.size() && !visited[j]; j++) {
+        visited[j] = true;
+
+        if (irs[j].opcode() == jl::OpCode::RETURN) {
+            return j;
+        }
+        if (irs[j].opcode() == jl::OpCode::JMP) {
+            // Continues at the label, which is skipped by the loop increment
+            j = labels[std::get<int>(irs[j].control().data)];
+        } else if (irs[j].opcode() != jl::OpCode::LABEL) {
+            return std::nullopt;
+        }
+    }
+
+    return std::nullopt;
+}
+
+static bool is_tail_call(const jl::Chunk& chunk, const std::vector<uint32_t>& labels, uint32_t i)
+{
+    const auto& irs = chunk.get_ir();
+
+    if (irs[i].type() != jl::Ir::CALL) {
+        return false;
+    }
+
+    const auto& call = irs[i].call();
+    if (call.func_name != chunk.m_name || call.extern_symbol) {
+        return false;
+    }
+
+    const auto ret = find_return(chunk, labels, i);
+    if (!ret) {
+        return false;
+    }
+
+    // Either the result of the call is returned or nothing is
+    const auto& value = irs[*ret].control().data;
+    if (jl::get_type(value) == jl::OperandType::TEMP) {
+        return std::get<jl::TempVar>(value).idx == call.return_var.idx;
+    }
+
+    return jl::get_type(value) == jl::OperandType::NIL && chunk.return_type == jl::OperandType::NIL;
+}
+
+void jl::eliminate_tail_calls(Chunk& chunk)
+{
+    if (chunk.extern_symbol) {
+        return;
+    }
+
+    const auto labels = find_labels(chunk);
+    std::vector<uint32_t> tail_calls;
+    for (uint32_t i = 0; i < chunk.get_ir().size(); i++) {
+        if (is_tail_call(chunk, labels, i)) {
+            tail_calls.push_back(i);
+        }
+    }
+
+    if (tail_calls.empty()) {
+        return;
+    }
+
+    const auto param_count = static_cast<uint32_t>(chunk.get_input_variable_names().size());
+    const auto is_param = [&](uint32_t temp) {
+        return temp >= 1 && temp <= param_count;
+    };
+
+    // A new call starts with every register zeroed, so temps read before
+    // they are written, like variables declared without a value, have to
+    // be cleared again before jumping back
+    const auto cfg = build_cfg(chunk);
+    const auto liveness = compute_liveness(chunk, cfg);
+    std::vector<uint32_t> cleared;
+
+    for (uint32_t t = 0; t < chunk.get_max_allocated_temps(); t++) {
+        const bool is_function = std::ranges::any_of(chunk.m_registered_functions, [&](const auto& func) {
+            return func.first == t;
+        });
+
+        if (liveness.live_in[0][t] && !is_param(t) && !is_function) {
+            cleared.push_back(t);
+        }
+    }
+
+    const auto entry_label = chunk.create_new_label();
+    const auto lines = chunk.get_lines();
+    std::vector<bool> removed(chunk.get_ir().size(), false);
+
+    // Insert from the back so the earlier positions stay valid
+    for (auto it = tail_calls.rbegin(); it != tail_calls.rend(); it++) {
+        const auto i = *it;
+        const auto call = chunk.get_ir()[i].call();
+        const auto line = lines[i];
+
+        std::vector<Ir> irs;
+        const auto move = [&](Operand source, uint32_t dest) {
+            irs.push_back(Ir { UnaryIr { OpCode::MOVE, source, TempVar { dest } } });
+        };
+
+        // When an argument is another parameter, like f(b, a) in f(a, b),
+        // all arguments are copied out before any parameter is written
+        bool overlaps = false;
+        for (uint32_t k = 0; k < call.args.size(); k++) {
+            overlaps = overlaps || (is_param(call.args[k].idx) && call.args[k].idx != k + 1);
+        }
+
+        if (overlaps) {
+            std::vector<uint32_t> copies;
+            for (uint32_t k = 0; k < call.args.size(); k++) {
+                copies.push_back(chunk.create_temp_var(chunk.get_nested_type(TempVar { k + 1 })).idx);
+                move(call.args[k], copies.back());
+            }
+            for (uint32_t k = 0; k < call.args.size(); k++) {
+                move(TempVar { copies[k] }, k + 1);
+            }
+        } else {
+            for (uint32_t k = 0; k < call.args.size(); k++) {
+                move(call.args[k], k + 1);
+            }
+        }
+
+        for (const auto t : cleared) {
+            move(Nil {}, t);
+        }
+
+        irs.push_back(Ir { ControlIr { OpCode::JMP, entry_label } });
+
+        // The CALL is replaced by the moves and the jump. A RETURN right
+        // after it is only reached from the call and goes too, one behind
+        // labels may still be the target of other jumps.
+        removed[i] = true;
+        if (chunk.get_ir()[i + 1].opcode() == OpCode::RETURN) {
+            removed[i + 1] = true;
+        }
+        chunk.insert_ir(i + 1, irs, std::vector<uint32_t>(irs.size(), line));
+        removed.insert(removed.begin() + i + 1, irs.size(), false);
+    }
+
+    chunk.remove_ir(removed);
+    chunk.insert_ir(0, { Ir { ControlIr { OpCode::LABEL, entry_label } } }, { lines.empty() ? 0 : lines.front() });
+}
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Chunk.hpp"
+
+namespace jl {
+
+// Turns a function calling itself right before returning into a jump back
+// to the start of the function with the parameters rebound, so the call
+// reuses the frame instead of growing the stack
+void eliminate_tail_calls(Chunk& chunk);
+
+}
\ No newline at end of file
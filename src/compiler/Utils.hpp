@@ -4,7 +4,7 @@
 #include <print>
 #include <stacktrace>
 
-inline void unimplemented(const char* msg = "")
+[[noreturn]] inline void unimplemented(const char* msg = "")
 {
     std::println("[Unimplemented]({})\n{}", msg, std::stacktrace::current());
     std::exit(1);
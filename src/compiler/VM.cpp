@@ -1,432 +1,431 @@
 #include "VM.hpp"
 
+#include <algorithm>
 #include <functional>
 #include <iostream>
 #include <utility>
 
-#include "Ir.hpp"
+#include "Bytecode.hpp"
 #include "OpCode.hpp"
 #include "Operand.hpp"
 #include "Utils.hpp"
 
-template <typename FromType, typename ToType>
-static void typecast(jl::reg_type& from, jl::reg_type& to)
+template <typename T>
+static inline jl::reg_type store_in_reg(const T& data)
 {
-    FromType fdata;
-    ToType tdata;
-    std::memcpy(&fdata, &from, sizeof(FromType));
-    tdata = static_cast<ToType>(fdata);
-    std::memcpy(&to, &tdata, sizeof(ToType));
+    jl::reg_type reg = 0;
+    std::memcpy(&reg, &data, sizeof(T));
+    return reg;
 }
 
-jl::VM::VM(const std::map<std::string, Chunk>& m_chunk_map, ptr_type data_address)
-    : m_chunk_map(m_chunk_map)
-    , m_base_address(data_address)
+template <typename FromType, typename ToType>
+static inline jl::reg_type typecast(jl::reg_type from)
 {
-    // Prepare the dispatch table
-    const auto add_to_table = [&](OperandType t1, OperandType t2, casting_func_t f) {
-        m_dispatch_table[{ t1, t2 }] = f;
-    };
-
-#define ADD_TO_TABLE(FROM, TO) \
-    add_to_table(OperandType::FROM, OperandType::TO, typecast<PrimitiveType<OperandType::FROM>::type, PrimitiveType<OperandType::TO>::type>)
+    return store_in_reg(static_cast<ToType>(jl::VM::get<FromType>(from)));
+}
 
-    ADD_TO_TABLE(INT, FLOAT);
-    ADD_TO_TABLE(FLOAT, INT);
+jl::VM::VM(const Program& program, size_t max_call_depth)
+    : m_program(program)
+    , m_code(program.code())
+    , m_root_id(program.root_id())
+    , m_data(program.data().begin(), program.data().end())
+    , m_base_address(reinterpret_cast<ptr_type>(m_data.data()))
+    , m_max_call_depth(max_call_depth)
+{
+    m_registers.reserve(initial_register_count);
 
-    ADD_TO_TABLE(INT, CHAR);
-    ADD_TO_TABLE(CHAR, INT);
+    size_t max_params = 0;
+    for (const auto& bc : m_code) {
+        if (bc.extern_func) {
+            max_params = std::max(max_params, bc.param_types.size());
+        }
 
-    ADD_TO_TABLE(NIL_PTR, CHAR_PTR);
-    ADD_TO_TABLE(NIL_PTR, INT_PTR);
-    ADD_TO_TABLE(NIL_PTR, FLOAT_PTR);
-    ADD_TO_TABLE(NIL_PTR, BOOL_PTR);
+        for (const auto& site : bc.call_sites) {
+            if (m_code[site.func_id].is_variadic) {
+                max_params = std::max<size_t>(max_params, site.arg_count);
+            }
+        }
+    }
 
-    ADD_TO_TABLE(CHAR_PTR, NIL_PTR);
-    ADD_TO_TABLE(INT_PTR, NIL_PTR);
-    ADD_TO_TABLE(FLOAT_PTR, NIL_PTR);
-    ADD_TO_TABLE(BOOL_PTR, NIL_PTR);
-#undef ADD_TO_TABLE
+    m_extern_args.resize(max_params);
+    m_map_strides.resize(max_params);
+    for (auto& arg : m_extern_args) {
+        m_extern_arg_ptrs.push_back(&arg);
+    }
 }
 
-template <typename T>
-static jl::reg_type store_in_reg(T& data)
-{
-    jl::reg_type reg;
-    std::memcpy(&reg, &data, sizeof(T));
-    return reg;
-}
+// GCC and Clang can take the address of a label, which lets every handler
+// jump straight to the handler of the next instruction
+#if defined(__GNUC__) && !defined(JL_NO_THREADED_DISPATCH)
+#define JL_THREADED_DISPATCH
+#endif
 
-static jl::reg_type extract_data(const jl::Operand& op)
+template <typename T, typename Op>
+static inline void binary(jl::reg_type* regs, const jl::Instruction& ins, Op bin_oper)
 {
-    switch (jl::get_type(op)) {
-    case jl::OperandType::TEMP:
-    case jl::OperandType::UNASSIGNED:
-        unimplemented();
-    case jl::OperandType::NIL:
-        return 0;
-    case jl::OperandType::INT:
-        return store_in_reg(std::get<jl::int_type>(op));
-    case jl::OperandType::FLOAT:
-        return store_in_reg(std::get<jl::float_type>(op));
-    case jl::OperandType::BOOL:
-        return store_in_reg(std::get<bool>(op));
-    case jl::OperandType::CHAR:
-        return store_in_reg(std::get<char>(op));
-    case jl::OperandType::CHAR_PTR:
-    case jl::OperandType::INT_PTR:
-    case jl::OperandType::FLOAT_PTR:
-    case jl::OperandType::BOOL_PTR:
-    case jl::OperandType::NIL_PTR:
-        return store_in_reg(std::get<jl::PtrVar>(op).offset);
-    }
-    unimplemented();
-    return 0;
+    const auto result = bin_oper(
+        jl::VM::get<T>(regs[ins.b]),
+        jl::VM::get<T>(regs[ins.c]));
+
+    regs[ins.a] = store_in_reg(result);
 }
 
-static jl::reg_type nested_extract(const jl::Operand& operand, const std::vector<jl::reg_type>& temp_vars)
+// The offset is an int_type index, scaled by the size of the element
+template <int64_t Scale>
+static inline jl::reg_type offset_ptr(jl::reg_type ptr, jl::reg_type offset)
 {
-    return jl::get_type(operand) == jl::OperandType::TEMP
-        ? temp_vars[std::get<jl::TempVar>(operand).idx]
-        : extract_data(operand);
+    const auto index = static_cast<int64_t>(jl::VM::get<jl::int_type>(offset));
+    return ptr + static_cast<jl::reg_type>(index * Scale);
 }
 
-template <typename Op>
-static const jl::reg_type execute_bitwise_and_modulus(
-    const jl::reg_type& op1,
-    const jl::reg_type& op2,
+template <typename T, typename Op>
+static inline void binary_const(
+    jl::reg_type* regs,
+    const jl::reg_type* constants,
+    const jl::Instruction& ins,
     Op bin_oper)
 {
-    return bin_oper(op1, op2);
+    const auto result = bin_oper(
+        jl::VM::get<T>(regs[ins.b]),
+        jl::VM::get<T>(constants[ins.c]));
+
+    regs[ins.a] = store_in_reg(result);
 }
 
-// TODO::Make sure both operands are int or float before arithametics
+// Continues with the next instruction if the comparison holds, otherwise
+// jumps to the target of the instruction
 template <typename Op>
-static const jl::reg_type execute_arithametic(
-    const jl::reg_type& op1,
-    const jl::reg_type& op2,
-    bool is_float,
-    Op bin_oper)
+static inline const jl::Instruction* branch_unless(
+    const jl::Instruction* code,
+    const jl::Instruction* ip,
+    jl::reg_type op1,
+    jl::reg_type op2,
+    Op cmp_oper)
 {
-    if (is_float) {
-        jl::float_type f1 = jl::VM::get<jl::float_type>(op1);
-        jl::float_type f2 = jl::VM::get<jl::float_type>(op2);
-        jl::reg_type reg;
-        jl::float_type result = bin_oper(f1, f2);
-
-        std::memcpy(&reg, &result, sizeof(jl::float_type));
-        return reg;
-    } else {
-        return bin_oper(op1, op2);
-    }
+    const auto holds = cmp_oper(
+        jl::VM::get<jl::int_type>(op1),
+        jl::VM::get<jl::int_type>(op2));
+
+    return holds ? ip + 1 : code + ip->a;
 }
 
-template <typename Op>
-static const jl::reg_type execute_boolean(
-    const jl::reg_type& op1,
-    const jl::reg_type& op2,
-    Op bin_oper)
+// Reads are zero extended to the size of a register
+template <typename T>
+static inline jl::reg_type read_bytes(jl::reg_type addr)
 {
-    return bin_oper(op1, op2);
+    T data;
+    std::memcpy(&data, reinterpret_cast<const void*>(addr), sizeof(T));
+    return data;
 }
 
-static const jl::reg_type do_arithametic(
-    const jl::reg_type& op1,
-    const jl::reg_type& op2,
-    const jl::OperandType operation_type,
-    jl::OpCode opcode)
+template <typename T>
+static inline void write_bytes(jl::reg_type addr, jl::reg_type value)
 {
-    jl::reg_type result;
-    bool is_float = false;
-
-    if (operation_type == jl::OperandType::FLOAT) {
-        is_float = true;
-    }
-
-    switch (opcode) {
-    case jl::OpCode::ADD:
-        result = execute_arithametic(op1, op2, is_float, std::plus<> {});
-        break;
-    case jl::OpCode::MINUS:
-        result = execute_arithametic(op1, op2, is_float, std::minus<> {});
-        break;
-    case jl::OpCode::STAR:
-        result = execute_arithametic(op1, op2, is_float, std::multiplies<> {});
-        break;
-    case jl::OpCode::SLASH:
-        result = execute_arithametic(op1, op2, is_float, std::divides<> {});
-        break;
-    case jl::OpCode::GREATER:
-        result = execute_arithametic(op1, op2, is_float, std::greater<> {});
-        break;
-    case jl::OpCode::LESS:
-        result = execute_arithametic(op1, op2, is_float, std::less<> {});
-        break;
-    case jl::OpCode::GREATER_EQUAL:
-        result = execute_arithametic(op1, op2, is_float, std::greater_equal<> {});
-        break;
-    case jl::OpCode::LESS_EQUAL:
-        result = execute_arithametic(op1, op2, is_float, std::less_equal<> {});
-        break;
-    case jl::OpCode::EQUAL:
-        result = execute_arithametic(op1, op2, is_float, std::equal_to<> {});
-        break;
-    case jl::OpCode::NOT_EQUAL:
-        result = execute_arithametic(op1, op2, is_float, std::not_equal_to<> {});
-        break;
-    case jl::OpCode::MODULUS:
-        result = execute_bitwise_and_modulus(op1, op2, std::modulus<> {});
-        break;
-    case jl::OpCode::BIT_AND:
-        result = execute_bitwise_and_modulus(op1, op2, std::bit_and<> {});
-        break;
-    case jl::OpCode::BIT_OR:
-        result = execute_bitwise_and_modulus(op1, op2, std::bit_or<> {});
-        break;
-    case jl::OpCode::BIT_XOR:
-        result = execute_bitwise_and_modulus(op1, op2, std::bit_xor<> {});
-        break;
-    case jl::OpCode::AND:
-        result = execute_boolean(op1, op2, std::logical_and<> {});
-        break;
-    case jl::OpCode::OR:
-        result = execute_boolean(op1, op2, std::logical_or<> {});
-        break;
-    default:
-        unimplemented();
-    }
-
-    return result;
+    const T data = static_cast<T>(value);
+    std::memcpy(reinterpret_cast<void*>(addr), &data, sizeof(T));
 }
 
 std::pair<jl::VM::InterpretResult, std::vector<jl::reg_type>> jl::VM::run()
 {
-    auto root_chunk = m_chunk_map.at("__root__");
-    std::vector<reg_type> temp_vars(root_chunk.get_max_allocated_temps());
-    const auto result = run(root_chunk, temp_vars);
+    const auto& root_chunk = m_code[m_root_id];
+    std::ranges::copy(m_program.data(), m_data.begin());
+
+    // The first register receives the return value of the root chunk
+    const size_t base = 1;
+    m_registers.assign(base + root_chunk.frame_size, 0);
+    m_frames.clear();
+    const auto result = run(m_root_id, base, 0);
 
-    return { result, temp_vars };
+    const auto root_window = m_registers.begin() + base;
+    return { result, { root_window, root_window + root_chunk.frame_size } };
 }
 
 jl::VM::InterpretResult jl::VM::run(
-    const Chunk& chunk,
-    std::vector<reg_type>& temp_vars)
+    uint32_t chunk_id,
+    size_t base,
+    size_t ret)
 {
-    const auto& irs = chunk.get_ir();
-    const auto locations = fill_labels(irs, chunk.get_max_labels());
-    uint32_t pc = 0;
-
-    while (pc < irs.size()) {
-        const auto& ir = irs[pc];
-        if (debug_run)
-            debug_print(chunk, pc, ir, temp_vars);
-        pc = execute_ir(ir, pc, chunk, temp_vars, locations);
-    }
+    const BytecodeChunk* chunk = &m_code[chunk_id];
+    const Instruction* code = chunk->code.data();
+    const reg_type* constants = chunk->constants.data();
+    reg_type* regs = m_registers.data() + base;
+    const Instruction* ip = code;
+    const reg_type data = m_base_address;
+    reg_type return_value = 0;
+
+    // Switches execution to another chunk after a call or a return
+    const auto load_chunk = [&](uint32_t id, size_t new_base) {
+        chunk_id = id;
+        base = new_base;
+        chunk = &m_code[id];
+        code = chunk->code.data();
+        constants = chunk->constants.data();
+        regs = m_registers.data() + base;
+    };
 
-    return InterpretResult::OK;
-}
+#ifdef JL_THREADED_DISPATCH
+    static const void* const dispatch_table[] = {
+#define JL_OP_LABEL(NAME) &&op_##NAME,
+        JL_BYTECODE_OPS(JL_OP_LABEL)
+#undef JL_OP_LABEL
+    };
 
-uint32_t jl::VM::execute_ir(
-    Ir ir,
-    uint32_t pc,
-    const Chunk& chunk,
-    std::vector<reg_type>& temp_vars,
-    const std::vector<uint32_t> locations)
-{
-    if (ir.opcode() == OpCode::CALL) {
-        const auto& cir = ir.call();
-        auto& func_chunk = m_chunk_map.at(cir.func_name);
-        temp_vars[cir.return_var.idx] = run_function(cir, chunk, func_chunk, temp_vars);
-        return pc + 1;
-    }
+    // In step-by-step mode every instruction goes through the debugger first
+    static const void* const debug_table[] = {
+#define JL_OP_DEBUG(NAME) &&op_debug,
+        JL_BYTECODE_OPS(JL_OP_DEBUG)
+#undef JL_OP_DEBUG
+    };
 
-    switch (ir.type()) {
-    case Ir::BINARY:
-        handle_binary_ir(ir, temp_vars);
-        return pc + 1;
-    case Ir::UNARY:
-        handle_unary_ir(ir, temp_vars);
-        return pc + 1;
-    case Ir::JUMP_STORE:
-    case Ir::CONTROL:
-        return handle_control_ir(pc, ir, temp_vars, locations);
-    case Ir::TYPE_CAST:
-        handle_type_cast(ir, temp_vars);
-        break;
-    case Ir::LOAD_STORE:
-        handle_load_store(ir, temp_vars);
-        break;
-    default:
-        unimplemented();
+    const void* const* table = debug_run ? debug_table : dispatch_table;
+
+#define CASE(NAME) op_##NAME:
+#define DISPATCH() goto* table[static_cast<uint8_t>(ip->op)]
+
+    DISPATCH();
+
+op_debug:
+    debug_print(*chunk, ip - code, regs);
+    goto* dispatch_table[static_cast<uint8_t>(ip->op)];
+#else
+#define CASE(NAME) case Op::NAME:
+#define DISPATCH() goto dispatch
+
+dispatch:
+    if (debug_run)
+        debug_print(*chunk, ip - code, regs);
+
+    switch (ip->op) {
+#endif
+
+#define NEXT() \
+    ip++;      \
+    DISPATCH()
+
+    CASE(ADD_INT) { binary<int_type>(regs, *ip, std::plus<> {}); } NEXT();
+    CASE(SUB_INT) { binary<int_type>(regs, *ip, std::minus<> {}); } NEXT();
+    CASE(MUL_INT) { binary<int_type>(regs, *ip, std::multiplies<> {}); } NEXT();
+    CASE(DIV_INT) { binary<int_type>(regs, *ip, std::divides<> {}); } NEXT();
+    CASE(MOD_INT) { binary<int_type>(regs, *ip, std::modulus<> {}); } NEXT();
+    CASE(LESS_INT) { binary<int_type>(regs, *ip, std::less<> {}); } NEXT();
+    CASE(LESS_EQUAL_INT) { binary<int_type>(regs, *ip, std::less_equal<> {}); } NEXT();
+    CASE(GREATER_INT) { binary<int_type>(regs, *ip, std::greater<> {}); } NEXT();
+    CASE(GREATER_EQUAL_INT) { binary<int_type>(regs, *ip, std::greater_equal<> {}); } NEXT();
+    CASE(EQUAL_INT) { binary<int_type>(regs, *ip, std::equal_to<> {}); } NEXT();
+    CASE(NOT_EQUAL_INT) { binary<int_type>(regs, *ip, std::not_equal_to<> {}); } NEXT();
+    CASE(BIT_AND_INT) { binary<int_type>(regs, *ip, std::bit_and<> {}); } NEXT();
+    CASE(BIT_OR_INT) { binary<int_type>(regs, *ip, std::bit_or<> {}); } NEXT();
+    CASE(BIT_XOR_INT) { binary<int_type>(regs, *ip, std::bit_xor<> {}); } NEXT();
+
+    CASE(ADD_FLOAT) { binary<float_type>(regs, *ip, std::plus<> {}); } NEXT();
+    CASE(SUB_FLOAT) { binary<float_type>(regs, *ip, std::minus<> {}); } NEXT();
+    CASE(MUL_FLOAT) { binary<float_type>(regs, *ip, std::multiplies<> {}); } NEXT();
+    CASE(DIV_FLOAT) { binary<float_type>(regs, *ip, std::divides<> {}); } NEXT();
+    CASE(LESS_FLOAT) { binary<float_type>(regs, *ip, std::less<> {}); } NEXT();
+    CASE(LESS_EQUAL_FLOAT) { binary<float_type>(regs, *ip, std::less_equal<> {}); } NEXT();
+    CASE(GREATER_FLOAT) { binary<float_type>(regs, *ip, std::greater<> {}); } NEXT();
+    CASE(GREATER_EQUAL_FLOAT) { binary<float_type>(regs, *ip, std::greater_equal<> {}); } NEXT();
+    CASE(EQUAL_FLOAT) { binary<float_type>(regs, *ip, std::equal_to<> {}); } NEXT();
+    CASE(NOT_EQUAL_FLOAT) { binary<float_type>(regs, *ip, std::not_equal_to<> {}); } NEXT();
+
+    CASE(LESS_CHAR) { binary<char>(regs, *ip, std::less<> {}); } NEXT();
+    CASE(LESS_EQUAL_CHAR) { binary<char>(regs, *ip, std::less_equal<> {}); } NEXT();
+    CASE(GREATER_CHAR) { binary<char>(regs, *ip, std::greater<> {}); } NEXT();
+    CASE(GREATER_EQUAL_CHAR) { binary<char>(regs, *ip, std::greater_equal<> {}); } NEXT();
+    CASE(EQUAL_CHAR) { binary<char>(regs, *ip, std::equal_to<> {}); } NEXT();
+    CASE(NOT_EQUAL_CHAR) { binary<char>(regs, *ip, std::not_equal_to<> {}); } NEXT();
+
+    CASE(AND_BOOL) { binary<bool>(regs, *ip, std::logical_and<> {}); } NEXT();
+    CASE(OR_BOOL) { binary<bool>(regs, *ip, std::logical_or<> {}); } NEXT();
+    CASE(LESS_BOOL) { binary<bool>(regs, *ip, std::less<> {}); } NEXT();
+    CASE(LESS_EQUAL_BOOL) { binary<bool>(regs, *ip, std::less_equal<> {}); } NEXT();
+    CASE(GREATER_BOOL) { binary<bool>(regs, *ip, std::greater<> {}); } NEXT();
+    CASE(GREATER_EQUAL_BOOL) { binary<bool>(regs, *ip, std::greater_equal<> {}); } NEXT();
+    CASE(EQUAL_BOOL) { binary<bool>(regs, *ip, std::equal_to<> {}); } NEXT();
+    CASE(NOT_EQUAL_BOOL) { binary<bool>(regs, *ip, std::not_equal_to<> {}); } NEXT();
+
+    CASE(ADD_PTR_8) { regs[ip->a] = offset_ptr<1>(regs[ip->b], regs[ip->c]); } NEXT();
+    CASE(ADD_PTR_32) { regs[ip->a] = offset_ptr<4>(regs[ip->b], regs[ip->c]); } NEXT();
+    CASE(ADD_PTR_64) { regs[ip->a] = offset_ptr<8>(regs[ip->b], regs[ip->c]); } NEXT();
+    CASE(SUB_PTR_8) { regs[ip->a] = offset_ptr<-1>(regs[ip->b], regs[ip->c]); } NEXT();
+    CASE(SUB_PTR_32) { regs[ip->a] = offset_ptr<-4>(regs[ip->b], regs[ip->c]); } NEXT();
+    CASE(SUB_PTR_64) { regs[ip->a] = offset_ptr<-8>(regs[ip->b], regs[ip->c]); } NEXT();
+    CASE(LESS_PTR) { binary<reg_type>(regs, *ip, std::less<> {}); } NEXT();
+    CASE(LESS_EQUAL_PTR) { binary<reg_type>(regs, *ip, std::less_equal<> {}); } NEXT();
+    CASE(GREATER_PTR) { binary<reg_type>(regs, *ip, std::greater<> {}); } NEXT();
+    CASE(GREATER_EQUAL_PTR) { binary<reg_type>(regs, *ip, std::greater_equal<> {}); } NEXT();
+    CASE(EQUAL_PTR) { binary<reg_type>(regs, *ip, std::equal_to<> {}); } NEXT();
+    CASE(NOT_EQUAL_PTR) { binary<reg_type>(regs, *ip, std::not_equal_to<> {}); } NEXT();
+
+    CASE(MOVE) { regs[ip->a] = regs[ip->b]; } NEXT();
+    CASE(MOVE_CONST) { regs[ip->a] = constants[ip->b]; } NEXT();
+    CASE(MOVE_DATA) { regs[ip->a] = data + constants[ip->b]; } NEXT();
+    CASE(NOT) { regs[ip->a] = !regs[ip->b]; } NEXT();
+    CASE(BIT_NOT) { regs[ip->a] = ~regs[ip->b]; } NEXT();
+
+    CASE(JMP)
+    {
+        ip = code + ip->a;
+        DISPATCH();
     }
-
-    return pc + 1;
-}
-
-void jl::VM::handle_binary_ir(const Ir& ir, std::vector<reg_type>& temp_vars)
-{
-    reg_type result;
-    const auto& binar_ir = ir.binary();
-
-    const auto& left = temp_vars[binar_ir.op1.idx];
-    const auto& right = temp_vars[binar_ir.op2.idx];
-
-    switch (jl::get_category(binar_ir.opcode)) {
-    case jl::OperatorCategory::ARITHAMETIC:
-    case jl::OperatorCategory::COMPARISON:
-    case jl::OperatorCategory::BOOLEAN:
-    case OperatorCategory::BITWISE_AND_MODULUS:
-        result = do_arithametic(left, right, binar_ir.type, binar_ir.opcode);
-        break;
-    case jl::OperatorCategory::OTHER:
-        unimplemented();
-        break;
+    CASE(JMP_UNLESS)
+    {
+        if (regs[ip->b] == false) {
+            ip = code + ip->a;
+        } else {
+            ip++;
+        }
+        DISPATCH();
     }
-
-    temp_vars[ir.dest().idx] = result;
-}
-
-void jl::VM::handle_unary_ir(const Ir& ir, std::vector<reg_type>& temp_vars)
-{
-    reg_type result;
-    const auto& unary_ir = ir.unary();
-    const auto operand = nested_extract(unary_ir.operand, temp_vars);
-
-    switch (ir.opcode()) {
-    case OpCode::MOVE: {
-        result = operand;
-    } break;
-    case jl::OpCode::NOT: {
-        result = !(operand);
-    } break;
-    case jl::OpCode::MINUS: {
-        // TODO::Remove this, no longer needed as codegen converts it to binary
-        result = -1 * operand;
-    } break;
-    case jl::OpCode::BIT_NOT: {
-        result = ~operand;
-    } break;
-    default:
-        unimplemented();
+    CASE(RETURN)
+    {
+        return_value = regs[ip->b];
+        goto return_from_call;
     }
-
-    temp_vars[ir.dest().idx] = result;
-}
-
-std::vector<uint32_t> jl::VM::fill_labels(const std::vector<Ir>& irs, uint32_t max_labels) const
-{
-    if (max_labels == 0) {
-        return {};
+    CASE(RETURN_CONST)
+    {
+        return_value = constants[ip->b];
+        goto return_from_call;
     }
+    CASE(RETURN_DATA)
+    {
+        return_value = data + constants[ip->b];
+        goto return_from_call;
+    }
+    CASE(CALL)
+    {
+        const auto& site = chunk->call_sites[ip->b];
+        const auto& func_chunk = m_code[site.func_id];
+
+        if (func_chunk.extern_symbol) {
+            const auto* func = func_chunk.is_variadic ? chunk->variadic_calls[ip->b] : func_chunk.extern_func;
+            call_extern(site, *chunk, *func, base, base + ip->a);
+            ip++;
+            DISPATCH();
+        }
 
-    std::vector<uint32_t> locations;
-    locations.resize(max_labels);
-
-    for (int i = 0; i < irs.size(); i++) {
-        const auto& ir = irs[i];
+        const auto return_pc = static_cast<uint32_t>(ip + 1 - code);
+        const auto callee_base = enter_function(site, chunk_id, return_pc, base, base + ip->a);
 
-        if (ir.opcode() == OpCode::LABEL) {
-            locations[std::get<int>(ir.control().data)] = i;
+        if (!callee_base) {
+            const auto line = chunk->lines[ip - code];
+            std::println("[line {}] Runtime error: call depth exceeded the limit of {}", line, m_max_call_depth);
+            return InterpretResult::RUNTIME_ERROR;
         }
-    }
 
-    return locations;
-}
+        load_chunk(site.func_id, *callee_base);
+        ip = code;
+        DISPATCH();
+    }
+    CASE(MAP_EXTERN)
+    {
+        const auto& site = chunk->call_sites[ip->b];
+        map_extern(site, *chunk, m_code[site.func_id], get<int_type>(regs[ip->c]), base);
+        ip++;
+        DISPATCH();
+    }
 
-uint32_t jl::VM::handle_control_ir(
-    const uint32_t pc,
-    const Ir& ir,
-    std::vector<reg_type>& temp_vars,
-    const std::vector<uint32_t>& label_locations)
-{
-    switch (ir.opcode()) {
-    case OpCode::LABEL:
-        break;
-    case OpCode::HALT:
+    CASE(INT_TO_FLOAT) { regs[ip->a] = typecast<int_type, float_type>(regs[ip->b]); } NEXT();
+    CASE(FLOAT_TO_INT) { regs[ip->a] = typecast<float_type, int_type>(regs[ip->b]); } NEXT();
+    CASE(INT_TO_CHAR) { regs[ip->a] = typecast<int_type, char>(regs[ip->b]); } NEXT();
+    CASE(CHAR_TO_INT) { regs[ip->a] = typecast<char, int_type>(regs[ip->b]); } NEXT();
+    CASE(FLOAT_TO_CHAR) { regs[ip->a] = typecast<float_type, char>(regs[ip->b]); } NEXT();
+    CASE(CHAR_TO_FLOAT) { regs[ip->a] = typecast<char, float_type>(regs[ip->b]); } NEXT();
+
+    CASE(LOAD_8) { regs[ip->a] = read_bytes<uint8_t>(regs[ip->b]); } NEXT();
+    CASE(LOAD_32) { regs[ip->a] = read_bytes<uint32_t>(regs[ip->b]); } NEXT();
+    CASE(LOAD_64) { regs[ip->a] = read_bytes<uint64_t>(regs[ip->b]); } NEXT();
+    CASE(STORE_8) { write_bytes<uint8_t>(regs[ip->b], regs[ip->a]); } NEXT();
+    CASE(STORE_32) { write_bytes<uint32_t>(regs[ip->b], regs[ip->a]); } NEXT();
+    CASE(STORE_64) { write_bytes<uint64_t>(regs[ip->b], regs[ip->a]); } NEXT();
+
+    CASE(JMP_UNLESS_LESS_INT) { ip = branch_unless(code, ip, regs[ip->b], regs[ip->c], std::less<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_LESS_EQUAL_INT) { ip = branch_unless(code, ip, regs[ip->b], regs[ip->c], std::less_equal<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_GREATER_INT) { ip = branch_unless(code, ip, regs[ip->b], regs[ip->c], std::greater<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_GREATER_EQUAL_INT) { ip = branch_unless(code, ip, regs[ip->b], regs[ip->c], std::greater_equal<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_EQUAL_INT) { ip = branch_unless(code, ip, regs[ip->b], regs[ip->c], std::equal_to<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_NOT_EQUAL_INT) { ip = branch_unless(code, ip, regs[ip->b], regs[ip->c], std::not_equal_to<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_LESS_INT_CONST) { ip = branch_unless(code, ip, regs[ip->b], constants[ip->c], std::less<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_LESS_EQUAL_INT_CONST) { ip = branch_unless(code, ip, regs[ip->b], constants[ip->c], std::less_equal<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_GREATER_INT_CONST) { ip = branch_unless(code, ip, regs[ip->b], constants[ip->c], std::greater<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_GREATER_EQUAL_INT_CONST) { ip = branch_unless(code, ip, regs[ip->b], constants[ip->c], std::greater_equal<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_EQUAL_INT_CONST) { ip = branch_unless(code, ip, regs[ip->b], constants[ip->c], std::equal_to<> {}); } DISPATCH();
+    CASE(JMP_UNLESS_NOT_EQUAL_INT_CONST) { ip = branch_unless(code, ip, regs[ip->b], constants[ip->c], std::not_equal_to<> {}); } DISPATCH();
+    CASE(ADD_INT_CONST) { binary_const<int_type>(regs, constants, *ip, std::plus<> {}); } NEXT();
+    CASE(SUB_INT_CONST) { binary_const<int_type>(regs, constants, *ip, std::minus<> {}); } NEXT();
+    CASE(LOAD_INDEXED_8) { regs[ip->a] = read_bytes<uint8_t>(offset_ptr<1>(regs[ip->b], regs[ip->c])); } NEXT();
+    CASE(LOAD_INDEXED_32) { regs[ip->a] = read_bytes<uint32_t>(offset_ptr<4>(regs[ip->b], regs[ip->c])); } NEXT();
+    CASE(LOAD_INDEXED_64) { regs[ip->a] = read_bytes<uint64_t>(offset_ptr<8>(regs[ip->b], regs[ip->c])); } NEXT();
+    CASE(STORE_INDEXED_8) { write_bytes<uint8_t>(offset_ptr<1>(regs[ip->b], regs[ip->c]), regs[ip->a]); } NEXT();
+    CASE(STORE_INDEXED_32) { write_bytes<uint32_t>(offset_ptr<4>(regs[ip->b], regs[ip->c]), regs[ip->a]); } NEXT();
+    CASE(STORE_INDEXED_64) { write_bytes<uint64_t>(offset_ptr<8>(regs[ip->b], regs[ip->c]), regs[ip->a]); } NEXT();
+
+    CASE(HALT)
+    {
         std::println("[Halting...]");
         std::exit(1);
-        break;
-    case OpCode::JMP: {
-        const auto label = std::get<int>(ir.control().data);
-        return label_locations[label];
-    } break;
-    case OpCode::JMP_UNLESS: {
-        const auto& condition = temp_vars[ir.jump().data.idx];
-        // Evaluate and jump
-        if (condition == false) {
-            const auto label = std::get<int>(ir.jump().target);
-            return label_locations[label];
-        } else {
-            return pc + 1;
-        }
-    } break;
-    case OpCode::RETURN: {
-        const auto& operand = ir.control().data;
-        const auto& data = nested_extract(operand, temp_vars);
-        ;
-        m_stack.push(data);
-        return UINT_MAX;
-    } break;
-    default:
-        unimplemented();
     }
 
-    return pc + 1;
-}
+return_from_call:
+    if (m_frames.empty()) {
+        m_registers[ret] = return_value;
+        return InterpretResult::OK;
+    } else {
+        const auto frame = m_frames.back();
+        m_frames.pop_back();
 
-uint64_t read_bytes_to_uint64_le(const void* ptr, size_t size)
-{
-    uint64_t temp = 0;
-    std::memcpy(&temp, ptr, size); // copies up to 8 bytes into temp
-    return temp;
-}
+        m_registers[frame.ret] = return_value;
+        load_chunk(frame.chunk_id, frame.base);
+        ip = code + frame.return_pc;
+        DISPATCH();
+    }
 
-void write_bytes_from_uint64_le(void* ptr, uint64_t val, size_t size)
-{
-    memcpy(ptr, &val, size);
-}
+#ifndef JL_THREADED_DISPATCH
+    }
+#endif
 
-void jl::VM::handle_load_store(const Ir& ir, std::vector<reg_type>& temp_vars)
-{
-    const auto ls_ir = ir.load_store();
-    const auto addr = temp_vars[ls_ir.addr.idx];
+#undef NEXT
+#undef DISPATCH
+#undef CASE
 
-    if (ls_ir.opcode == OpCode::LOAD) {
-        temp_vars[ls_ir.reg.idx] = read_bytes_to_uint64_le((char*)(addr), ls_ir.size);
-    } else {
-        // This should be a store
-        write_bytes_from_uint64_le((char*)(addr), temp_vars[ls_ir.reg.idx], ls_ir.size);
-    }
+    return InterpretResult::OK;
 }
 
 std::pair<jl::VM::InterpretResult, std::vector<jl::reg_type>> jl::VM::interactive_execute()
 {
     debug_run = true;
-    auto root_chunk = m_chunk_map.at("__root__");
-    std::vector<reg_type> temp_vars(root_chunk.get_max_allocated_temps());
-    const auto result = run(root_chunk, temp_vars);
-    return { result, temp_vars };
+    return run();
+}
+
+std::span<const uint8_t> jl::VM::data() const
+{
+    return m_data;
 }
 
 void jl::VM::debug_print(
-    const Chunk& chunk,
+    const BytecodeChunk& chunk,
     uint32_t pc,
-    const Ir& ir,
-    const std::vector<reg_type>& temp_vars)
+    const reg_type* regs)
 {
     std::cout << "================================================================================\n";
 
-    std::cout << pc << " >";
-    chunk.print_ir(std::cout, ir);
+    std::cout << pc << " > " << to_string(chunk.code[pc].op) << " |";
+    if (chunk.source) {
+        chunk.source->print_ir(std::cout, chunk.source->get_ir()[chunk.origins[pc]]);
+    }
     std::cout << '\n';
 
-    for (int i = 0; i < temp_vars.size(); i++) {
+    for (uint32_t i = 0; i < chunk.frame_size; i++) {
         if (i % 8 == 0)
             std::cout << '\n';
 
         std::cout << i << ": [";
-        const auto& op = temp_vars[i];
-        std::cout << pretty_print(op, chunk.get_nested_type(TempVar { static_cast<uint32_t>(i) })) << "]\t";
+        const auto& op = regs[i];
+        // Bytecode loaded from a file has no types, so show the raw value
+        const auto type = chunk.source
+            ? chunk.source->get_nested_type(TempVar { i })
+            : OperandType::INT_PTR;
+        std::cout << pretty_print(op, type) << "]\t";
     }
     std::cout << '\n';
 
@@ -434,36 +433,93 @@ void jl::VM::debug_print(
     std::cin.get();
 }
 
-jl::reg_type jl::VM::run_function(
-    const CallIr& ir,
-    const Chunk& curr_chunk,
-    const Chunk& func_chunk,
-    const std::vector<reg_type>& temp_vars)
+std::optional<size_t> jl::VM::enter_function(
+    const CallSite& site,
+    uint32_t chunk_id,
+    uint32_t return_pc,
+    size_t base,
+    size_t dest)
 {
-    if (!func_chunk.extern_symbol) {
-        std::vector<reg_type> stack_vars(func_chunk.get_max_allocated_temps());
-        for (int i = 0; i < ir.args.size(); i++) {
-            // First temp var will always be the fucntion itself
-            stack_vars[i + 1] = temp_vars[ir.args[i].idx];
-        }
+    if (m_frames.size() >= m_max_call_depth) {
+        return std::nullopt;
+    }
 
-        run(func_chunk, stack_vars);
-        const auto ret_value = m_stack.top();
+    const auto& curr_chunk = m_code[chunk_id];
+    const auto& func_chunk = m_code[site.func_id];
+    const auto* args = &curr_chunk.call_args[site.args_offset];
 
-        return ret_value;
-    } else {
-        std::vector<std::pair<reg_type, OperandType>> args;
-        for (int i = 0; i < ir.args.size(); i++) {
-            const auto type = curr_chunk.get_nested_type(TempVar { ir.args[i].idx });
-            args.push_back({ temp_vars[ir.args[i].idx], type });
+    // The window of the callee starts right after the caller's
+    const auto callee_base = base + curr_chunk.frame_size;
+    const auto callee_end = callee_base + func_chunk.frame_size;
+
+    if (m_registers.size() < callee_end) {
+        m_registers.resize(callee_end);
+    }
+
+    std::fill(m_registers.begin() + callee_base, m_registers.begin() + callee_end, 0);
+    for (uint32_t i = 0; i < site.arg_count; i++) {
+        // First temp var will always be the fucntion itself
+        m_registers[callee_base + i + 1] = m_registers[base + args[i]];
+    }
+
+    m_frames.push_back({ return_pc, chunk_id, base, dest });
+    return callee_base;
+}
+
+void jl::VM::call_extern(
+    const CallSite& site,
+    const BytecodeChunk& curr_chunk,
+    const CFFI::Function& func,
+    size_t base,
+    size_t dest)
+{
+    const auto* args = &curr_chunk.call_args[site.args_offset];
+    for (uint32_t i = 0; i < site.arg_count; i++) {
+        m_extern_args[i] = m_registers[base + args[i]];
+    }
+
+    m_registers[dest] = CFFI::call(func, m_extern_arg_ptrs.data());
+}
+
+void jl::VM::map_extern(
+    const CallSite& site,
+    const BytecodeChunk& curr_chunk,
+    const BytecodeChunk& func_chunk,
+    int_type count,
+    size_t base)
+{
+    const auto& func = *func_chunk.extern_func;
+    const auto& params = func_chunk.param_types;
+    const auto* args = &curr_chunk.call_args[site.args_offset];
+    const auto* arg_types = &curr_chunk.call_arg_types[site.args_offset];
+
+    const bool has_dest = func_chunk.return_type != OperandType::NIL;
+    const auto dest = has_dest ? m_registers[base + args[0]] : 0;
+    const auto dest_size = has_dest ? size_of_type(func_chunk.return_type) : 0;
+    if (has_dest) {
+        args++;
+        arg_types++;
+    }
+
+    for (size_t i = 0; i < params.size(); i++) {
+        m_extern_args[i] = m_registers[base + args[i]];
+        m_map_strides[i] = arg_types[i] == params[i] ? 0 : size_of_type(params[i]);
+    }
+
+    for (int_type n = 0; n < count; n++) {
+        for (size_t i = 0; i < params.size(); i++) {
+            if (m_map_strides[i] != 0) {
+                const auto addr = m_registers[base + args[i]] + n * m_map_strides[i];
+                m_extern_args[i] = 0;
+                std::memcpy(&m_extern_args[i], reinterpret_cast<const void*>(addr), m_map_strides[i]);
+            }
         }
 
-        reg_type ret_value = m_ffi.call(
-            *func_chunk.extern_symbol,
-            args,
-            func_chunk.return_type);
+        const auto result = CFFI::call(func, m_extern_arg_ptrs.data());
 
-        return ret_value;
+        if (has_dest) {
+            std::memcpy(reinterpret_cast<void*>(dest + n * dest_size), &result, dest_size);
+        }
     }
 }
 
@@ -478,25 +534,4 @@ T convert_variant(const jl::Operand& v)
         }
     },
         v);
-}
-
-void jl::VM::handle_type_cast(const Ir& ir, std::vector<reg_type>& temp_vars)
-{
-    if (ir.opcode() != OpCode::TYPE_CAST) {
-        unimplemented();
-    }
-
-    const auto cir = ir.cast();
-    auto& from = temp_vars[cir.source.idx];
-    auto& to = temp_vars[cir.dest.idx];
-
-    if (cir.from == cir.to) {
-        to = from;
-    } else {
-        if (m_dispatch_table.contains({ cir.from, cir.to })) {
-            m_dispatch_table[{ cir.from, cir.to }](from, to);
-        } else {
-            unimplemented();
-        }
-    }
-}
+}
\ No newline at end of file
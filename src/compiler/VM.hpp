@@ -3,17 +3,23 @@
 #include <cstdint>
 #include <cstring>
 #include <map>
-#include <stack>
+#include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
+#include "Bytecode.hpp"
 #include "CFFI.hpp"
 #include "Chunk.hpp"
 #include "Operand.hpp"
+#include "Program.hpp"
 #include "Utils.hpp"
 
 namespace jl {
 
+// One running instance of a program. Everything a run writes to, the
+// registers, the frames and the data section, belongs to the VM, so VMs
+// sharing a program do not see each other.
 class VM {
 public:
     enum InterpretResult {
@@ -22,12 +28,18 @@ public:
         RUNTIME_ERROR,
     };
 
-    VM(const std::map<std::string, Chunk>& chunk_map, ptr_type data_address);
+    static constexpr size_t default_max_call_depth = 1 << 16;
 
+    explicit VM(const Program& program, size_t max_call_depth = default_max_call_depth);
+
+    // Every run starts from the initial data section of the program
     std::pair<InterpretResult, std::vector<reg_type>> run();
 
     std::pair<InterpretResult, std::vector<reg_type>> interactive_execute();
 
+    // The data section as the last run left it
+    std::span<const uint8_t> data() const;
+
     template <typename T>
     static T get(const ptr_type& val)
     {
@@ -65,55 +77,77 @@ public:
     }
 
 private:
-    const std::map<std::string, Chunk>& m_chunk_map;
+    // Where execution continues once the callee returns
+    struct Frame {
+        uint32_t return_pc;
+        uint32_t chunk_id;
+        // Register window of the caller
+        size_t base;
+        // Absolute index of the register receiving the return value
+        size_t ret;
+    };
+
+    const Program& m_program;
+    // Bytecode is never modified once lowered. Executing an instruction other
+    // than a call does not allocate.
+    const std::vector<BytecodeChunk>& m_code;
+    uint32_t m_root_id;
+    std::vector<uint8_t> m_data;
+    // Address of m_data, which never moves after construction
     ptr_type m_base_address;
-    std::stack<reg_type> m_stack;
+    // Every call gets a window of registers on this stack
+    std::vector<reg_type> m_registers;
+    // Calls never recurse on the native stack, every active call of June
+    // code has a frame here instead
+    std::vector<Frame> m_frames;
+    size_t m_max_call_depth;
+    // Arguments of an extern call, widened to registers, and pointers to
+    // each of them. Sized for the extern call with the most arguments.
+    std::vector<reg_type> m_extern_args;
+    std::vector<void*> m_extern_arg_ptrs;
+    // Element size of every array argument of a map, zero for arguments
+    // passed unchanged to every call
+    std::vector<size_t> m_map_strides;
     bool debug_run = false;
-    CFFI m_ffi { "/lib64/libc.so.6" };
 
-    using casting_func_t = void (*)(jl::reg_type&, jl::reg_type&);
-    std::map<std::pair<jl::OperandType, jl::OperandType>, casting_func_t> m_dispatch_table;
+    static constexpr size_t initial_register_count = 1 << 14;
 
+    // Executes a chunk and every function it calls with its registers
+    // starting at `base` and writes the return value to the register at `ret`
     InterpretResult run(
-        const Chunk& chunk,
-        std::vector<reg_type>& temp_vars);
-
-    uint32_t execute_ir(
-        Ir ir,
-        uint32_t pc,
-        const Chunk& chunk,
-        std::vector<reg_type>& temp_vars,
-        const std::vector<uint32_t> locations);
-
-    void handle_binary_ir(const Ir& ir, std::vector<reg_type>& temp_vars);
-
-    void handle_unary_ir(
-        const Ir& ir,
-        std::vector<reg_type>& temp_vars);
-
-    uint32_t handle_control_ir(
-        const uint32_t pc,
-        const Ir& ir,
-        std::vector<reg_type>& temp_vars,
-        const std::vector<uint32_t>& label_locations);
-
-    void handle_type_cast(const Ir& ir, std::vector<reg_type>& temp_vars);
-
-    void handle_load_store(const Ir& ir, std::vector<reg_type>& temp_vars);
-
-    std::vector<uint32_t> fill_labels(const std::vector<Ir>& irs, uint32_t max_labels) const;
+        uint32_t chunk_id,
+        size_t base,
+        size_t ret);
 
     void debug_print(
-        const Chunk& chunk,
+        const BytecodeChunk& chunk,
         uint32_t pc,
-        const Ir& ir,
-        const std::vector<reg_type>& temp_vars);
-
-    reg_type run_function(
-        const CallIr& ir,
-        const Chunk& curr_chunk,
-        const Chunk& func_chunk,
-        const std::vector<reg_type>& temp_vars);
+        const reg_type* regs);
+
+    // Pushes a frame returning to `return_pc` and sets up the register
+    // window of the callee. Returns the base of the window or nothing if
+    // the call would go past the maximum depth.
+    std::optional<size_t> enter_function(
+        const CallSite& site,
+        uint32_t chunk_id,
+        uint32_t return_pc,
+        size_t base,
+        size_t dest);
+
+    void call_extern(
+        const CallSite& site,
+        const BytecodeChunk& curr_chunk,
+        const CFFI::Function& func,
+        size_t base,
+        size_t dest);
+
+    // Calls the extern `count` times in a native loop over the arrays
+    void map_extern(
+        const CallSite& site,
+        const BytecodeChunk& curr_chunk,
+        const BytecodeChunk& func_chunk,
+        int_type count,
+        size_t base);
 
     template <typename T>
     static T read_data(ptr_type offset)
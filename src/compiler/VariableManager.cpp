@@ -27,6 +27,7 @@ jl::TempVar jl::VariableManager::create_temp_var(OperandType type)
     };
 
     m_var_types.push_back(type);
+    m_variables.push_back(false);
 
     return var;
 }
@@ -39,6 +40,7 @@ std::optional<jl::TempVar> jl::VariableManager::store_variable(const std::string
 
     TempVar var = create_temp_var(type);
     m_variable_map.back().insert(std::pair { var_name, var.idx });
+    m_variables[var.idx] = true;
 
     return var;
 }
@@ -217,4 +219,34 @@ bool jl::VariableManager::check_type_cast(OperandType from, OperandType to)
         return true;
 
     return false;
+}
+
+bool jl::VariableManager::is_variable(uint32_t idx) const
+{
+    return m_variables[idx];
+}
+
+void jl::VariableManager::remap_temps(const std::vector<uint32_t>& new_index, uint32_t new_count)
+{
+    std::vector<OperandType> var_types(new_count, OperandType::UNASSIGNED);
+    std::vector<bool> variables(new_count, false);
+
+    for (uint32_t i = 0; i < m_var_count; i++) {
+        if (new_index[i] == dropped_temp) {
+            continue;
+        }
+
+        var_types[new_index[i]] = m_var_types[i];
+        variables[new_index[i]] = variables[new_index[i]] || m_variables[i];
+    }
+
+    for (auto& map : m_variable_map) {
+        for (auto& [name, var] : map) {
+            var = new_index[var];
+        }
+    }
+
+    m_var_types = std::move(var_types);
+    m_variables = std::move(variables);
+    m_var_count = new_count;
 }
\ No newline at end of file
@@ -23,6 +23,7 @@ public:
     std::optional<TempVar> store_variable(const std::string& var_name, OperandType type);
 
     OperandType get_var_data_type(uint32_t idx) const;
+    bool is_variable(uint32_t idx) const;
     std::optional<TempVar> look_up_variable(const std::string& var_name) const;
     OperandType get_nested_type(const Operand& operand) const;
     const std::unordered_map<std::string, uint32_t>& get_variable_map() const;
@@ -37,10 +38,17 @@ public:
 
     bool check_type_cast(OperandType from, OperandType to);
 
+    // Moves every temp var to `new_index[idx]`, temp vars mapped to
+    // `dropped_temp` are removed
+    void remap_temps(const std::vector<uint32_t>& new_index, uint32_t new_count);
+    static uint32_t constexpr dropped_temp { UINT32_MAX };
+
 private:
     static uint32_t constexpr max_data_types { 6 };
     uint32_t m_var_count { 0 };
     std::vector<OperandType> m_var_types;
+    // Temp vars backing a named variable
+    std::vector<bool> m_variables;
     std::vector<std::unordered_map<std::string, uint32_t>> m_variable_map;
 };
 
@@ -86,7 +86,13 @@ void jl::Lexer::scan_token()
         add_token(Token::COLON);
         break;
     case '.':
-        add_token(Token::DOT);
+        if (peek() == '.' && peek_next() == '.') {
+            advance();
+            advance();
+            add_token(Token::ELLIPSIS);
+        } else {
+            add_token(Token::DOT);
+        }
         break;
     case '&':
         add_token(Token::BIT_AND);
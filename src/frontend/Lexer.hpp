@@ -65,6 +65,7 @@ private:
         { "break", Token::BREAK },
         { "extern", Token::EXTERN },
         { "as", Token::AS },
+        { "from", Token::FROM },
     };
 };
 } // namespace jl
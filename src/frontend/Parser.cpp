@@ -683,6 +683,10 @@ jl::Stmt* jl::Parser::function(const char* kind)
     func->m_body = body;
     func->is_extern = false;
 
+    if (func->m_is_variadic) {
+        ErrorHandler::error(m_file_name, func->m_name.get_line(), "Only extern functions can take variable arguments");
+    }
+
     return func;
 }
 
@@ -751,11 +755,17 @@ jl::Stmt* jl::Parser::extern_declaration()
 {
     Token& extern_token = previous();
     Token& symbol_name = consume(Token::STRING, "Expected symbol name as str after `extern`");
+
+    Token* library_name = nullptr;
+    if (match({ Token::FROM })) {
+        library_name = &consume(Token::STRING, "Expected library name as str after `from`");
+    }
+
     consume(Token::AS, "Expected `as` after symbol name");
     FuncStmt* june_func = function_declaration();
     consume(Token::SEMI_COLON, "Expected ; after extern declaration");
 
-    Stmt* extern_stmt = new ExternStmt(extern_token, symbol_name, june_func);
+    Stmt* extern_stmt = new ExternStmt(extern_token, symbol_name, library_name, june_func);
     m_allocated_refs.push_back(extern_stmt);
     return extern_stmt;
 }
@@ -767,9 +777,16 @@ jl::FuncStmt* jl::Parser::function_declaration()
     consume(Token::LEFT_PAR, "Expected ( after fun name");
     std::vector<Token*> parameters;
     std::vector<TypeInfo> data_types;
+    bool is_variadic = false;
 
     if (!check(Token::RIGHT_PAR)) {
         do {
+            // Variable arguments can only come after every parameter
+            if (match({ Token::ELLIPSIS })) {
+                is_variadic = true;
+                break;
+            }
+
             if (parameters.size() >= 255) {
                 ErrorHandler::error(
                     m_file_name,
@@ -806,6 +823,7 @@ jl::FuncStmt* jl::Parser::function_declaration()
     }
 
     FuncStmt* func = new FuncStmt(name, parameters, std::move(data_types), return_type);
+    func->m_is_variadic = is_variadic;
     m_allocated_refs.push_back(func);
     return func;
 }
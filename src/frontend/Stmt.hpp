@@ -200,6 +200,8 @@ public:
     std::optional<TypeInfo> m_return_type;
     std::vector<Stmt*> m_body;
     bool is_extern;
+    // Takes any number of arguments after its parameters, only for externs
+    bool m_is_variadic { false };
 
     inline FuncStmt(
         Token& name,
@@ -334,11 +336,14 @@ class ExternStmt : public Stmt {
 public:
     Token& m_extern_token;
     Token& m_symbol_name;
+    // Null when the symbol is looked up in the default library
+    Token* m_library_name;
     FuncStmt* m_june_func;
 
-    inline ExternStmt(Token& extern_token, Token& symbol_name, FuncStmt* june_func)
+    inline ExternStmt(Token& extern_token, Token& symbol_name, Token* library_name, FuncStmt* june_func)
         : m_extern_token(extern_token)
         , m_symbol_name(symbol_name)
+        , m_library_name(library_name)
         , m_june_func(june_func)
     {
     }
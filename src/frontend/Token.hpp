@@ -44,6 +44,7 @@ public:
         BIT_OR,
         BIT_XOR,
         BIT_NOT,
+        ELLIPSIS,
         // Literals
         STRING,
         FLOAT,
@@ -71,7 +72,8 @@ public:
         SUPER,
         BREAK,
         EXTERN,
-        AS
+        AS,
+        FROM
     };
 
     Token(TokenType type, std::string& lexeme, int line);
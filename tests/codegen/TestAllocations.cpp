@@ -0,0 +1,131 @@
+#include "Utils.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "CodeGenerator.hpp"
+#include "ErrorHandler.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "VM.hpp"
+
+// Counts every allocation made through operator new in allocation_tests, which
+// only holds this file so the other tests keep the standard operator new
+static size_t allocation_count = 0;
+
+void* operator new(std::size_t size)
+{
+    allocation_count++;
+
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+// Returns the number of allocations made while the VM executes the program
+static size_t count_run_allocations(const std::string& source_code)
+{
+    using namespace jl;
+
+    std::string file_name = "test.jun";
+    jl::Lexer lexer(source_code.c_str());
+    lexer.scan();
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    auto tokens = lexer.get_tokens();
+    jl::Parser parser(tokens, file_name);
+    auto stmts = parser.parseStatements();
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::Interpreter interpreter(file_name);
+    jl::Resolver resolver(interpreter, file_name);
+    resolver.resolve(stmts);
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::CodeGenerator codegen(file_name);
+    auto [chunk_map, data_section] = codegen.generate(stmts);
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::optimize(chunk_map);
+
+    const jl::Program program(chunk_map, data_section);
+    jl::VM vm(program);
+
+    const auto before = allocation_count;
+    const auto [status, temp_vars] = vm.run();
+    const auto after = allocation_count;
+
+    REQUIRE(status == jl::VM::OK);
+
+    return after - before;
+}
+
+static std::string loop_program(int iterations)
+{
+    return R"(
+        var list = {1, 2, 3};
+        var sum = 0;
+        var total = 0.0;
+
+        for (var i = 0; i < )"
+        + std::to_string(iterations) + R"(; i += 1) [
+            if (i % 2 == 0 and list[i % 3] != 0) [
+                sum += list[i % 3];
+            ]
+
+            list[i % 3] = i;
+            total += i as float;
+        ]
+)";
+}
+
+TEST_CASE("No allocations per executed instruction", "[Codegen]")
+{
+    const auto short_run = count_run_allocations(loop_program(10));
+    const auto long_run = count_run_allocations(loop_program(10000));
+
+    REQUIRE(short_run == long_run);
+}
+static std::string extern_program(int iterations)
+{
+    return R"(
+        extern "abs" as abs(n: int): int;
+        extern "strlen" as strLen(s: [char]): int;
+
+        var total = 0;
+
+        for (var i = 0; i < )"
+        + std::to_string(iterations) + R"(; i += 1) [
+            total += abs(0 - i) + strLen("june");
+        ]
+)";
+}
+
+TEST_CASE("No allocations per extern call", "[Codegen]")
+{
+    const auto short_run = count_run_allocations(extern_program(10));
+    const auto long_run = count_run_allocations(extern_program(10000));
+
+    REQUIRE(short_run == long_run);
+}
\ No newline at end of file
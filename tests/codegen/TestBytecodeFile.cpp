@@ -0,0 +1,344 @@
+#include "Utils.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "BytecodeFile.hpp"
+#include "CodeGenerator.hpp"
+#include "ErrorHandler.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "Program.hpp"
+#include "Resolver.hpp"
+#include "VM.hpp"
+
+static const auto file_name = (std::filesystem::temp_directory_path() / "june_test.junec").string();
+
+// Compiles the source into a .junec file and returns the root chunk
+static jl::Chunk compile_to_file(const char* source_code)
+{
+    using namespace jl;
+
+    std::string source_name = "test.jun";
+    jl::Lexer lexer(source_code);
+    lexer.scan();
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    auto tokens = lexer.get_tokens();
+    jl::Parser parser(tokens, source_name);
+    auto stmts = parser.parseStatements();
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::Interpreter interpreter(source_name);
+    jl::Resolver resolver(interpreter, source_name);
+    resolver.resolve(stmts);
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::CodeGenerator codegen(source_name);
+    auto [chunk_map, data_section] = codegen.generate(stmts);
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::optimize(chunk_map);
+
+    const auto function_ids = assign_function_ids(chunk_map);
+    const auto code = lower_all(chunk_map, function_ids);
+    REQUIRE(write_bytecode_file(file_name, code, function_ids.at("__root__"), data_section));
+
+    return codegen.get_root_chunk();
+}
+
+TEST_CASE("Running a bytecode file", "[BytecodeFile]")
+{
+    using namespace jl;
+
+    const auto root = compile_to_file(R"(
+        extern "strcmp" as strCmp(s1: [char], s2: [char]): int;
+
+        fun count(str: [char], target: char): int [
+            var n = 0;
+            for (var i = 0; i < 9; i += 1) [
+                if (str[i] == target) [
+                    n += 1;
+                ]
+            ]
+            return n;
+        ]
+
+        var str: [char] = "Malayalam";
+        str[0] = 'a';
+        var a_count = count(str, 'a');
+        var same = strCmp(str, "aalayalam") == 0;
+        var half = 7 / 2.0;
+)");
+
+    BytecodeFile file(file_name);
+    REQUIRE(file.is_valid());
+
+    const auto root_id = file.root_id();
+    const Program program(file.take_code(), root_id, file.data());
+    VM vm(program);
+    const auto [status, temp_vars] = vm.run();
+    REQUIRE(status == VM::OK);
+
+    const auto get = [&](const char* name) {
+        return temp_vars[root.get_variable_map().at(name)];
+    };
+
+    REQUIRE(VM::get<int>(get("a_count")) == 5);
+    REQUIRE(VM::get<bool>(get("same")) == true);
+    REQUIRE(VM::get<double>(get("half")) == 3.5);
+
+    std::remove(file_name.c_str());
+}
+
+TEST_CASE("VMs sharing a program", "[BytecodeFile]")
+{
+    using namespace jl;
+
+    const auto root = compile_to_file(R"(
+        var str: [char] = "june";
+        var first = str[0];
+        str[0] = 'J';
+)");
+
+    BytecodeFile file(file_name);
+    REQUIRE(file.is_valid());
+
+    const auto root_id = file.root_id();
+    const Program program(file.take_code(), root_id, file.data());
+    const auto first = root.get_variable_map().at("first");
+
+    // Every VM starts from the data of the program, whatever the others wrote
+    std::vector<std::thread> threads;
+    std::vector<char> results(4, 0);
+
+    for (size_t i = 0; i < results.size(); i++) {
+        threads.emplace_back([&, i] {
+            VM vm(program);
+            for (int run = 0; run < 100; run++) {
+                const auto [status, temp_vars] = vm.run();
+                results[i] = status == VM::OK ? VM::get<char>(temp_vars[first]) : '\0';
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(results == std::vector<char>(4, 'j'));
+    REQUIRE(program.data()[0] == 'j');
+
+    std::remove(file_name.c_str());
+}
+
+static std::vector<char> read_file()
+{
+    std::ifstream file(file_name, std::ios::binary);
+    return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+TEST_CASE("Compiling the same source twice", "[BytecodeFile]")
+{
+    const auto source = R"(
+        fun twice(x: int): int [
+            return x * 2;
+        ]
+
+        var list = {1, 2, 3};
+        var sum = 0;
+        for (var i = 0; i < 3; i += 1) [
+            sum += twice(list[i]);
+        ]
+)";
+
+    compile_to_file(source);
+    const auto first = read_file();
+    compile_to_file(source);
+    const auto second = read_file();
+
+    REQUIRE(!first.empty());
+    REQUIRE(first == second);
+
+    std::remove(file_name.c_str());
+}
+
+// Writes the bytes with `value` copied over them at `offset`, and loads them
+template <typename T>
+static bool is_valid_with(const std::vector<char>& original, size_t offset, T value)
+{
+    auto bytes = original;
+    std::memcpy(bytes.data() + offset, &value, sizeof(value));
+    std::ofstream(file_name, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+    return jl::BytecodeFile(file_name).is_valid();
+}
+
+TEST_CASE("Rejecting invalid bytecode files", "[BytecodeFile]")
+{
+    using namespace jl;
+
+    compile_to_file(R"(
+        var sum = 0;
+        for (var i = 0; i < 3; i += 1) [
+            sum += i;
+        ]
+)");
+
+    const auto original = read_file();
+
+    // The only chunk is the root, which is not an extern
+    constexpr size_t chunk_offset = bytecode_header_size;
+    constexpr size_t return_type_offset = chunk_offset + 2 * sizeof(uint32_t);
+    constexpr size_t frame_size_offset = chunk_offset + bytecode_code_size_offset - sizeof(uint32_t);
+    constexpr size_t code_size_offset = chunk_offset + bytecode_code_size_offset;
+    constexpr size_t code_offset = chunk_offset + bytecode_code_offset;
+    // Fields of an instruction
+    constexpr size_t a_offset = sizeof(Op);
+    constexpr size_t b_offset = a_offset + sizeof(uint32_t);
+
+    uint32_t code_size;
+    std::memcpy(&code_size, original.data() + code_size_offset, sizeof(code_size));
+    REQUIRE(static_cast<Op>(original[code_offset]) == Op::MOVE_CONST);
+
+    const auto is_valid = [&](size_t offset, auto value) {
+        return is_valid_with(original, offset, value);
+    };
+
+    REQUIRE(is_valid(code_offset, original[code_offset]));
+
+    // Unknown opcode
+    REQUIRE(is_valid(code_offset, uint8_t { 0xff }) == false);
+    // Destination register outside of the frame
+    REQUIRE(is_valid(code_offset + a_offset, uint32_t { 0x0fffffff }) == false);
+    // Constant index outside of the constants
+    REQUIRE(is_valid(code_offset + b_offset, uint32_t { 0x0fffffff }) == false);
+    // Call site that does not exist
+    REQUIRE(is_valid(code_offset, static_cast<uint8_t>(Op::CALL)) == false);
+    // A return turned into a move runs past the end of the code
+    REQUIRE(is_valid(code_offset + (code_size - 1) * bytecode_instruction_size, static_cast<uint8_t>(Op::MOVE)) == false);
+    // Unknown return type
+    REQUIRE(is_valid(return_type_offset, uint8_t { 0xff }) == false);
+    // A frame far larger than any function needs
+    REQUIRE(is_valid(frame_size_offset, uint32_t { 0xff000000 }) == false);
+
+    // Jumps past the end of the code
+    bool has_jump = false;
+    for (uint32_t i = 0; i < code_size; i++) {
+        const auto offset = code_offset + i * bytecode_instruction_size;
+        const auto op = static_cast<Op>(original[offset]);
+
+        if (op == Op::JMP || (op >= Op::JMP_UNLESS_LESS_INT && op <= Op::JMP_UNLESS_NOT_EQUAL_INT_CONST)) {
+            REQUIRE(is_valid(offset + a_offset, code_size) == false);
+            has_jump = true;
+        }
+    }
+    REQUIRE(has_jump);
+
+    // A move of a constant turned into a move of data past the end of the
+    // data section, which is empty here
+    const auto constants_offset = code_offset + code_size * bytecode_instruction_size;
+    bool has_data = false;
+    for (uint32_t i = 0; i < code_size && !has_data; i++) {
+        const auto offset = code_offset + i * bytecode_instruction_size;
+        if (static_cast<Op>(original[offset]) != Op::MOVE_CONST) {
+            continue;
+        }
+
+        uint32_t index;
+        uint64_t constant;
+        std::memcpy(&index, original.data() + offset + b_offset, sizeof(index));
+        std::memcpy(&constant, original.data() + constants_offset + index * sizeof(constant), sizeof(constant));
+
+        if (constant != 0) {
+            REQUIRE(is_valid(offset, static_cast<uint8_t>(Op::MOVE_DATA)) == false);
+            has_data = true;
+        }
+    }
+    REQUIRE(has_data);
+
+    // A june function without code
+    BytecodeChunk empty;
+    empty.frame_size = 1;
+    REQUIRE(write_bytecode_file(file_name, { empty }, 0, DataSection {}));
+    REQUIRE(BytecodeFile(file_name).is_valid() == false);
+
+    // An extern returning a type without a c type
+    BytecodeChunk root;
+    root.frame_size = 1;
+    root.constants = { 0 };
+    root.code = { Instruction { .op = Op::RETURN_CONST, .a = 0, .b = 0, .c = 0 } };
+    root.lines = { 1 };
+    BytecodeChunk abs;
+    abs.extern_symbol = "abs";
+    abs.return_type = OperandType::TEMP;
+    abs.param_types = { OperandType::INT };
+    REQUIRE(write_bytecode_file(file_name, { root, abs }, 0, DataSection {}));
+    REQUIRE(BytecodeFile(file_name).is_valid() == false);
+
+    // And one taking a parameter without a c type
+    abs.return_type = OperandType::INT;
+    abs.param_types = { OperandType::TEMP };
+    REQUIRE(write_bytecode_file(file_name, { root, abs }, 0, DataSection {}));
+    REQUIRE(BytecodeFile(file_name).is_valid() == false);
+
+    // Cut the file in the middle of the first chunk
+    compile_to_file(R"(
+        var a = 1;
+)");
+    std::filesystem::resize_file(file_name, 48);
+    REQUIRE(BytecodeFile(file_name).is_valid() == false);
+
+    std::ofstream(file_name, std::ios::trunc) << "not bytecode at all, but long enough for a header";
+    REQUIRE(BytecodeFile(file_name).is_valid() == false);
+
+    std::remove(file_name.c_str());
+    REQUIRE(BytecodeFile(file_name).is_valid() == false);
+}
+
+TEST_CASE("Rejecting invalid argument types", "[BytecodeFile]")
+{
+    using namespace jl;
+
+    compile_to_file(R"(
+        extern "abs" as abs(x: int): int;
+
+        var a = abs(0 - 3);
+)");
+
+    const auto original = read_file();
+
+    // The root sorts before abs, so it is the first chunk
+    constexpr size_t chunk_offset = bytecode_header_size;
+    constexpr size_t counts_offset = chunk_offset + bytecode_code_size_offset;
+    uint32_t counts[4];
+    std::memcpy(counts, original.data() + counts_offset, sizeof(counts));
+    const auto [code_size, constant_count, call_site_count, call_arg_count] = counts;
+    REQUIRE(call_arg_count == 1);
+
+    const auto arg_type_offset = chunk_offset + bytecode_code_offset
+        + code_size * bytecode_instruction_size
+        + constant_count * sizeof(reg_type)
+        + call_site_count * sizeof(CallSite)
+        + call_arg_count * sizeof(uint32_t);
+    REQUIRE(static_cast<OperandType>(original[arg_type_offset]) == OperandType::INT);
+
+    REQUIRE(is_valid_with(original, arg_type_offset, original[arg_type_offset]));
+    REQUIRE(is_valid_with(original, arg_type_offset, uint8_t { 0xff }) == false);
+    REQUIRE(is_valid_with(original, arg_type_offset, static_cast<uint8_t>(OperandType::TEMP)) == false);
+
+    std::remove(file_name.c_str());
+}
\ No newline at end of file
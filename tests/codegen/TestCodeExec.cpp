@@ -1,19 +1,23 @@
-#include "StaticAddressPass.hpp"
 #include "Utils.hpp"
 #include "catch2/catch_test_macros.hpp"
 
+#include <dlfcn.h>
+#include <filesystem>
 #include <utility>
 
+#include "CFFI.hpp"
 #include "CodeGenerator.hpp"
 #include "ErrorHandler.hpp"
 #include "Interpreter.hpp"
 #include "Lexer.hpp"
+#include "Optimizer.hpp"
 #include "Operand.hpp"
 #include "Parser.hpp"
 #include "Resolver.hpp"
 #include "VM.hpp"
 
 struct CompileData {
+    jl::VM::InterpretResult status;
     std::vector<jl::reg_type> temp_vars;
     jl::Chunk chunk;
 
@@ -27,7 +31,7 @@ struct CompileData {
 };
 
 static CompileData
-compile(const char* source_code)
+compile(const char* source_code, size_t max_call_depth = jl::VM::default_max_call_depth)
 {
     using namespace jl;
 
@@ -54,14 +58,15 @@ compile(const char* source_code)
 
     REQUIRE(jl::ErrorHandler::has_error() == false);
 
-    jl::patch_memmory_address(chunk_map, (uint64_t)data_section.data());
+    jl::optimize(chunk_map);
 
-    jl::VM vm(chunk_map, (ptr_type)data_section.data());
+    const jl::Program program(chunk_map, data_section);
+    jl::VM vm(program, max_call_depth);
     auto chunk = codegen.get_root_chunk();
     const auto [status, temp_vars] = vm.run();
     const auto var_map = chunk.get_variable_map();
 
-    return { std::move(temp_vars), std::move(chunk) };
+    return { status, std::move(temp_vars), std::move(chunk) };
 }
 
 TEST_CASE("Expressions", "[Codegen]")
@@ -150,6 +155,34 @@ TEST_CASE("If ladders", "[Codegen]")
     REQUIRE(data.get<int>(c_value) == 2);
 }
 
+TEST_CASE("Compare and branch", "[Codegen]")
+{
+    using namespace jl;
+
+    const auto data = compile(R"(
+        var count = 0;
+        var limit = 5;
+
+        for (var i = 0; i < 10; i += 1) [
+            if (i <= 2) [ count += 1; ]
+            if (i > 7) [ count += 10; ]
+            if (i >= 9) [ count += 100; ]
+            if (i == 4) [ count += 1000; ]
+            if (i != 4) [ count += 10000; ]
+            if (i < limit) [ count += 100000; ]
+            if (limit <= i) [ count += 1000000; ]
+        ]
+
+        var down = 10;
+        while (down > limit) [
+            down -= 2;
+        ]
+)");
+
+    REQUIRE(data.get<int_type>("count") == 5591123);
+    REQUIRE(data.get<int_type>("down") == 4);
+}
+
 TEST_CASE("Simple Function", "[Codegen]")
 {
     using namespace jl;
@@ -206,6 +239,51 @@ TEST_CASE("Recursive function", "[Codegen]")
     REQUIRE(data.get<int>(a_value) == 120);
 }
 
+TEST_CASE("Deep recursion", "[Codegen]")
+{
+    using namespace jl;
+
+    const auto data = compile(R"(
+        fun sum(n: int, acc: int): int [
+            if (n == 0) [
+                return acc;
+            ]
+
+            var next = n - 1;
+            return sum(next, acc + n);
+        ]
+
+        var a = sum(5000, 0);
+        var b = sum(10, 0);
+)");
+
+    REQUIRE(data.get<int>("a") == 12502500);
+    REQUIRE(data.get<int>("b") == 55);
+}
+
+TEST_CASE("Call depth limit", "[Codegen]")
+{
+    using namespace jl;
+
+    const auto source = R"(
+        fun depth(n: int): int [
+            if (n == 0) [
+                return 0;
+            ]
+
+            return 1 + depth(n - 1);
+        ]
+
+        var a = depth(20000);
+)";
+
+    const auto data = compile(source);
+    REQUIRE(data.status == VM::OK);
+    REQUIRE(data.get<int>("a") == 20000);
+
+    REQUIRE(compile(source, 1000).status == VM::RUNTIME_ERROR);
+}
+
 TEST_CASE("Fibonacci function", "[Codegen]")
 {
     using namespace jl;
@@ -260,6 +338,34 @@ TEST_CASE("Test Charachters", "[Codegen]")
     REQUIRE(data.get<char>(c_value) == '+');
 }
 
+TEST_CASE("Type casts", "[Codegen]")
+{
+    using namespace jl;
+
+    const auto data = compile(R"(
+        var i = 65;
+        var f = i as float;
+        var c = i as char;
+        var ci = 'b' as int;
+        var fi = 7.9 as int;
+        var fc = 66.0 as char;
+        var cf = 'a' as float;
+
+        var list = {1, 2, 3};
+        var any = list as [nil];
+        var back = any as [int];
+        var x = back[2];
+)");
+
+    REQUIRE(data.get<float_type>("f") == 65.0);
+    REQUIRE(data.get<char>("c") == 'A');
+    REQUIRE(data.get<int_type>("ci") == 98);
+    REQUIRE(data.get<int_type>("fi") == 7);
+    REQUIRE(data.get<char>("fc") == 'B');
+    REQUIRE(data.get<float_type>("cf") == 97.0);
+    REQUIRE(data.get<int_type>("x") == 3);
+}
+
 TEST_CASE("Index Get: Frequency Count", "[Codegen]")
 {
     using namespace jl;
@@ -384,6 +490,40 @@ TEST_CASE("Pointer types", "[Codegen]")
     REQUIRE(data.get<bool>(bc_value) == true);
 }
 
+TEST_CASE("Pointer arithmetic", "[Codegen]")
+{
+    using namespace jl;
+
+    const auto data = compile(R"(
+        var ia = {1, 2, 3, 4, 5};
+        var ip = ia + 3;
+        var ib = ip[0];
+        var ic = ip[-1];
+        var iq = ip - 2;
+        var id = iq[0];
+        var same = ia + 1 == iq;
+
+        var fa = {1.0, 2.5, 4.0};
+        var fp = 1 + fa;
+        var fb = fp[1];
+
+        var ca = {'h', 'e', 'l', 'l', 'o'};
+        var cp = ca + 4;
+        var cb = cp[0];
+        var less = ca[0] < cb;
+)");
+
+    REQUIRE(data.get<int_type>("ib") == 4);
+    REQUIRE(data.get<int_type>("ic") == 3);
+    REQUIRE(data.get<int_type>("id") == 2);
+    REQUIRE(data.get<bool>("same") == true);
+
+    REQUIRE(data.get<float_type>("fb") == 4.0);
+
+    REQUIRE(data.get<char>("cb") == 'o');
+    REQUIRE(data.get<bool>("less") == true);
+}
+
 TEST_CASE("Int and Float Pointers in functions", "[Codegen]")
 {
     using namespace jl;
@@ -561,6 +701,163 @@ TEST_CASE("C FFI", "[Codegen]")
     REQUIRE(data.get<int>(ten) == 10);
 }
 
+TEST_CASE("C FFI from other libraries", "[Codegen]")
+{
+    using namespace jl;
+
+    // A library only found through a search path, which is libm under
+    // another name
+    Dl_info info;
+    REQUIRE(dladdr(CFFI::instance().resolve("sqrt", "libm.so.6"), &info) != 0);
+
+    const auto dir = std::filesystem::temp_directory_path() / "june_test_libs";
+    std::filesystem::create_directories(dir);
+    std::filesystem::remove(dir / "libjunemath.so");
+    std::filesystem::create_symlink(info.dli_fname, dir / "libjunemath.so");
+    CFFI::instance().add_search_path(dir.string());
+
+    const auto data = compile(R"(
+        extern "sqrt" from "libm.so.6" as sqrt(x: float): float;
+        extern "pow" from "libjunemath.so" as pow(x: float, y: float): float;
+        extern "abs" as abs(x: int): int;
+
+        var a = sqrt(9.0);
+        var b = pow(2.0, 10.0);
+        var c = abs(0 - 5);
+)");
+
+    REQUIRE(data.get<double>("a") == 3.0);
+    REQUIRE(data.get<double>("b") == 1024.0);
+    REQUIRE(data.get<int>("c") == 5);
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("C FFI trampolines", "[Codegen]")
+{
+    using namespace jl;
+    using enum OperandType;
+
+    REQUIRE(CFFI::find_trampoline({}, INT) != nullptr);
+    REQUIRE(CFFI::find_trampoline({ CHAR_PTR, INT, INT_PTR, NIL_PTR }, NIL) != nullptr);
+    REQUIRE(CFFI::find_trampoline({ FLOAT }, FLOAT) != nullptr);
+
+    // Unusual signatures go through libffi
+    REQUIRE(CFFI::find_trampoline({ INT, INT, INT, INT, INT }, INT) == nullptr);
+    REQUIRE(CFFI::find_trampoline({ CHAR }, INT) == nullptr);
+    REQUIRE(CFFI::find_trampoline({ FLOAT, FLOAT }, FLOAT) == nullptr);
+    REQUIRE(CFFI::find_trampoline({ INT }, BOOL) == nullptr);
+
+    // Both ways of calling give the same value
+    auto abs = CFFI::instance().prepare("abs", std::nullopt, { INT }, INT);
+    auto strchr = CFFI::instance().prepare("strchr", std::nullopt, { CHAR_PTR, INT }, CHAR_PTR);
+    REQUIRE(abs.trampoline != nullptr);
+    REQUIRE(strchr.trampoline != nullptr);
+
+    const char* str = "june";
+    reg_type args[] = { static_cast<uint32_t>(-7), reinterpret_cast<reg_type>(str), 'n' };
+    void* abs_args[] = { &args[0] };
+    void* strchr_args[] = { &args[1], &args[2] };
+
+    const auto abs_direct = CFFI::call(abs, abs_args);
+    const auto strchr_direct = CFFI::call(strchr, strchr_args);
+    abs.trampoline = nullptr;
+    strchr.trampoline = nullptr;
+
+    REQUIRE(VM::get<int_type>(abs_direct) == 7);
+    REQUIRE(abs_direct == CFFI::call(abs, abs_args));
+    REQUIRE(strchr_direct == reinterpret_cast<reg_type>(str + 2));
+    REQUIRE(strchr_direct == CFFI::call(strchr, strchr_args));
+
+    const auto data = compile(R"(
+        extern "sqrt" from "libm.so.6" as sqrt(x: float): float;
+        extern "strlen" as strLen(s: [char]): int;
+        extern "toupper" as toUpper(c: char): int;
+
+        var a = sqrt(16.0);
+        var b = strLen("trampoline");
+        var c = toUpper('j');
+)");
+
+    REQUIRE(data.get<double>("a") == 4.0);
+    REQUIRE(data.get<int>("b") == 10);
+    REQUIRE(data.get<int>("c") == 'J');
+}
+
+TEST_CASE("C FFI variadic functions", "[Codegen]")
+{
+    using namespace jl;
+
+    const auto data = compile(R"(
+        extern "snprintf" as format(str: [char], size: int, fmt: [char], ...): int;
+        extern "strcmp" as strCmp(s1: [char], s2: [char]): int;
+
+        var buff: [char; 64];
+        var length = format(buff, 64, "%d %.2f %c %s %d", 0 - 7, 2.5, 'x', "june", true);
+        var a = strCmp(buff, "-7 2.50 x june 1") == 0;
+
+        format(buff, 64, "%s", "again");
+        var b = strCmp(buff, "again") == 0;
+
+        var no_args = format(buff, 64, "none");
+)");
+
+    REQUIRE(data.get<int>("length") == 16);
+    REQUIRE(data.get<bool>("a") == true);
+    REQUIRE(data.get<bool>("b") == true);
+    REQUIRE(data.get<int>("no_args") == 4);
+}
+
+TEST_CASE("Mapping externs over arrays", "[Codegen]")
+{
+    using namespace jl;
+
+    const auto data = compile(R"(
+        extern "abs" as abs(x: int): int;
+        extern "pow" from "libm.so.6" as pow(x: float, y: float): float;
+        extern "memset" as memset(s: [char], c: int, n: int);
+
+        var nums: [int; 5];
+        var floats: [float; 5];
+        for (var i = 0; i < 5; i += 1) [
+            nums[i] = 0 - i;
+            floats[i] = i as float;
+        ]
+
+        var abs_nums: [int; 5];
+        map(abs, 5, abs_nums, nums);
+
+        var squares: [float; 5];
+        map(pow, 5, squares, floats, 2.0);
+
+        var abs_sum = 0;
+        var square_sum = 0.0;
+        for (var i = 0; i < 5; i += 1) [
+            abs_sum += abs_nums[i];
+            square_sum += squares[i];
+        ]
+
+        var codes: [int; 3];
+        codes[0] = 97;
+        codes[1] = 98;
+        codes[2] = 99;
+        var buff: [char; 4];
+        map(memset, 3, buff, codes, 2);
+        var first = buff[0];
+        var second = buff[1];
+
+        var untouched = 7;
+        map(abs, 0, abs_nums, untouched);
+        var kept = abs_nums[0];
+)");
+
+    REQUIRE(data.get<int>("abs_sum") == 10);
+    REQUIRE(data.get<double>("square_sum") == 30.0);
+    REQUIRE(data.get<char>("first") == 'c');
+    REQUIRE(data.get<char>("second") == 'c');
+    REQUIRE(data.get<int>("kept") == 0);
+}
+
 TEST_CASE("Typed array declaration", "[Codegen]")
 {
     using namespace jl;
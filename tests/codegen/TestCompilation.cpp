@@ -1,4 +1,3 @@
-#include "StaticAddressPass.hpp"
 #include "Utils.hpp"
 #include "catch2/catch_test_macros.hpp"
 
@@ -6,6 +5,7 @@
 #include "ErrorHandler.hpp"
 #include "Interpreter.hpp"
 #include "Lexer.hpp"
+#include "Optimizer.hpp"
 #include "Parser.hpp"
 #include "Resolver.hpp"
 #include "VM.hpp"
@@ -37,9 +37,10 @@ jl::VM::InterpretResult compile(std::string file_name)
 
     REQUIRE(ErrorHandler::has_error() == false);
 
-    jl::patch_memmory_address(chunk_map, (reg_type)data_section.data());
+    optimize(chunk_map);
 
-    VM vm(chunk_map, (ptr_type)data_section.data());
+    const Program program(chunk_map, data_section);
+    VM vm(program);
     auto chunk = codegen.get_root_chunk();
     const auto [result, vars] = vm.run();
     return result;
@@ -178,3 +178,16 @@ TEST_CASE("Incorrect array type 1", "[Codegen Fail]")
         var bool: [int; 3] = {true, false, true};
     )");
 }
+
+TEST_CASE("Mapping an extern returning a pointer", "[Codegen Fail]")
+{
+    using namespace jl;
+
+    compile(R"( 
+        extern "getenv" as getenv(s: [char]): [char];
+
+        var names: [char; 4] = "abc";
+        var values: [char; 4];
+        map(getenv, 1, values, names);
+    )");
+}
@@ -0,0 +1,499 @@
+#include "Utils.hpp"
+#include "catch2/catch_test_macros.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Bytecode.hpp"
+#include "CodeGenerator.hpp"
+#include "ControlFlowGraph.hpp"
+#include "ErrorHandler.hpp"
+#include "Interpreter.hpp"
+#include "Lexer.hpp"
+#include "Optimizer.hpp"
+#include "Parser.hpp"
+#include "Resolver.hpp"
+#include "VM.hpp"
+
+struct OptimizedData {
+    std::vector<jl::reg_type> temp_vars;
+    std::map<std::string, jl::Chunk> chunk_map;
+
+    template <typename T>
+    T get(const char* name) const
+    {
+        const auto var = chunk_map.at("__root__").get_variable_map().at(name);
+        return jl::VM::get<T>(temp_vars[var]);
+    }
+
+    uint32_t frame_size(const char* chunk_name) const
+    {
+        return chunk_map.at(chunk_name).get_max_allocated_temps();
+    }
+};
+
+static OptimizedData
+compile(const char* source_code, const jl::OptimizerOptions& options)
+{
+    using namespace jl;
+
+    std::string file_name = "test.jun";
+    jl::Lexer lexer(source_code);
+    lexer.scan();
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    auto tokens = lexer.get_tokens();
+    jl::Parser parser(tokens, file_name);
+    auto stmts = parser.parseStatements();
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::Interpreter interpreter(file_name);
+    jl::Resolver resolver(interpreter, file_name);
+    resolver.resolve(stmts);
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::CodeGenerator codegen(file_name);
+    auto [chunk_map, data_section] = codegen.generate(stmts);
+
+    REQUIRE(jl::ErrorHandler::has_error() == false);
+
+    jl::optimize(chunk_map, options);
+
+    const jl::Program program(chunk_map, data_section);
+    jl::VM vm(program);
+    const auto [status, temp_vars] = vm.run();
+
+    REQUIRE(status == jl::VM::InterpretResult::OK);
+
+    return { std::move(temp_vars), chunk_map };
+}
+
+static constexpr jl::OptimizerOptions no_optimizations {
+    .eliminate_tail_calls = false,
+    .inline_functions = false,
+    .fold_constants = false,
+    .eliminate_dead_code = false,
+    .hoist_loop_invariants = false,
+    .allocate_registers = false,
+};
+
+static size_t count_ir(const jl::Chunk& chunk, jl::Ir::Type type)
+{
+    return std::ranges::count_if(chunk.get_ir(), [&](const jl::Ir& ir) { return ir.type() == type; });
+}
+
+TEST_CASE("Register allocation shrinks frames", "[Optimizer]")
+{
+    const auto source = R"(
+        fun poly(x: int): int [
+            var a = x * x + 2 * x + 1;
+            var b = (x - 1) * (x + 1) * (x - 2) * (x + 2);
+            var c = (a + b) * (a - b) + (a * 3) - (b * 5);
+            return a + b + c;
+        ]
+
+        var result = poly(3);
+)";
+
+    const auto plain = compile(source, no_optimizations);
+    const auto allocated = compile(source, {});
+
+    REQUIRE(allocated.frame_size("poly") < plain.frame_size("poly"));
+    REQUIRE(allocated.frame_size("__root__") <= plain.frame_size("__root__"));
+    REQUIRE(allocated.get<int>("result") == plain.get<int>("result"));
+    REQUIRE(allocated.get<int>("result") == -1440);
+}
+
+TEST_CASE("Register allocation keeps values live across loops", "[Optimizer]")
+{
+    const auto source = R"(
+        fun sum_squares(n: int): int [
+            var sum = 0;
+            var i = 0;
+
+            while (i < n) [
+                sum += (i * i) + (i - i);
+                i += 1;
+            ]
+
+            return sum * 2 - sum;
+        ]
+
+        var result = sum_squares(10);
+        var square = (result + 1) * (result - 1);
+)";
+
+    const auto data = compile(source, {});
+
+    REQUIRE(data.get<int>("result") == 285);
+    REQUIRE(data.get<int>("square") == 285 * 285 - 1);
+}
+
+TEST_CASE("Constant folding", "[Optimizer]")
+{
+    const auto source = R"(
+        var size = 10;
+        var area = size * size;
+        var scaled = area / 4.0;
+        var big = area > 50;
+        var ch = 'a' < 'b';
+        var wrapped = 2147483647 + size - 10 + 1;
+
+        if (area > 50) [
+            area = area + 1;
+        ] else [
+            area = 0;
+        ]
+)";
+
+    const auto plain = compile(source, no_optimizations);
+    const auto folded = compile(source, { .allocate_registers = false });
+    const auto& root = folded.chunk_map.at("__root__");
+
+    REQUIRE(count_ir(root, jl::Ir::BINARY) == 0);
+    REQUIRE(count_ir(root, jl::Ir::TYPE_CAST) == 0);
+    REQUIRE(count_ir(root, jl::Ir::JUMP_STORE) == 0);
+
+    REQUIRE(folded.get<int>("area") == 101);
+    REQUIRE(folded.get<double>("scaled") == 25.0);
+    REQUIRE(folded.get<bool>("big") == true);
+    REQUIRE(folded.get<bool>("ch") == true);
+    REQUIRE(folded.get<int>("wrapped") == plain.get<int>("wrapped"));
+}
+
+TEST_CASE("Constant folding stops at unknown values", "[Optimizer]")
+{
+    const auto source = R"(
+        fun add_one(x: int): int [
+            return x + 1;
+        ]
+
+        var i = 0;
+        var sum = 0;
+        while (i < 5) [
+            sum += i * 2;
+            i += 1;
+        ]
+
+        var result = add_one(sum) * 2;
+)";
+
+    const auto data = compile(source, {});
+
+    REQUIRE(data.get<int>("i") == 5);
+    REQUIRE(data.get<int>("sum") == 20);
+    REQUIRE(data.get<int>("result") == 42);
+}
+
+TEST_CASE("Dead code elimination", "[Optimizer]")
+{
+    const auto source = R"(
+        fun clamp(x: int): int [
+            var unused = x * 3 + 7;
+            if (x > 10) [
+                return 10;
+                x = x + 100;
+            ]
+            return x;
+            x = x * 2;
+        ]
+
+        var low = clamp(4);
+        var high = clamp(40);
+)";
+
+    const auto plain = compile(source, no_optimizations);
+    const auto cleaned = compile(source, { .fold_constants = false, .allocate_registers = false });
+    const auto& clamp = cleaned.chunk_map.at("clamp");
+
+    REQUIRE(clamp.get_ir().size() < plain.chunk_map.at("clamp").get_ir().size());
+    REQUIRE(count_ir(clamp, jl::Ir::BINARY) == 3);
+    REQUIRE(clamp.get_ir().back().opcode() == jl::OpCode::RETURN);
+
+    REQUIRE(cleaned.get<int>("low") == 4);
+    REQUIRE(cleaned.get<int>("high") == 10);
+}
+
+TEST_CASE("Control flow graph of nested loops", "[Optimizer]")
+{
+    const auto source = R"(
+        var s = 0;
+        for (var i = 0; i < 3; i += 1) [
+            for (var j = 0; j < 4; j += 1) [
+                s += j;
+            ]
+        ]
+)";
+
+    const auto data = compile(source, no_optimizations);
+    const auto cfg = jl::build_cfg(data.chunk_map.at("__root__"));
+
+    REQUIRE(data.get<int>("s") == 18);
+    REQUIRE(cfg.loops.size() == 2);
+
+    const auto& outer = cfg.loops[0];
+    const auto& inner = cfg.loops[1];
+
+    REQUIRE(outer.depth == 1);
+    REQUIRE(inner.depth == 2);
+    REQUIRE(inner.parent == 0);
+    REQUIRE(outer.blocks.size() > inner.blocks.size());
+    REQUIRE(cfg.dominates(outer.header, inner.header));
+    REQUIRE(!cfg.dominates(inner.header, outer.header));
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        REQUIRE(cfg.dominates(0, b));
+        REQUIRE(cfg.loop_depth(b) <= 2);
+    }
+
+    for (const auto latch : inner.latches) {
+        REQUIRE(cfg.loop_depth(latch) == 2);
+        REQUIRE(cfg.dominates(inner.header, latch));
+    }
+}
+
+// Number of ir inside any loop of the chunk
+static size_t count_loop_ir(const jl::Chunk& chunk)
+{
+    const auto cfg = jl::build_cfg(chunk);
+    size_t count = 0;
+
+    for (uint32_t b = 0; b < cfg.blocks.size(); b++) {
+        if (cfg.loop_depth(b) > 0) {
+            count += cfg.blocks[b].end - cfg.blocks[b].begin;
+        }
+    }
+
+    return count;
+}
+
+TEST_CASE("Loop invariant code motion", "[Optimizer]")
+{
+    const auto source = R"(
+        var list = {5, 3, 8, 1, 9, 2};
+        var size = 6;
+        var sum = 0;
+        var never = 0;
+
+        for (var i = 0; i < size - 1; i += 1) [
+            for (var j = 0; j < size - 1; j += 1) [
+                sum += list[j] * 2 + (size * 3);
+            ]
+        ]
+
+        while (size < 0) [
+            never = size * 100;
+        ]
+)";
+
+    const auto plain = compile(source, { .hoist_loop_invariants = false, .allocate_registers = false });
+    const auto hoisted = compile(source, { .allocate_registers = false });
+
+    REQUIRE(count_loop_ir(hoisted.chunk_map.at("__root__")) < count_loop_ir(plain.chunk_map.at("__root__")));
+    REQUIRE(hoisted.get<int>("sum") == plain.get<int>("sum"));
+    REQUIRE(hoisted.get<int>("sum") == 710);
+    REQUIRE(hoisted.get<int>("never") == 0);
+}
+
+TEST_CASE("Fusing superinstructions", "[Optimizer]")
+{
+    const auto source = R"(
+        var list = {4, 8, 15, 16, 23, 42};
+        var sum = 0;
+
+        for (var i = 0; i < 6; i += 1) [
+            list[i] = list[i] * 2;
+        ]
+
+        for (var i = 0; i < 6; i += 1) [
+            sum += list[i];
+        ]
+)";
+
+    // Hoisting would move the constants the fused ops take out of the loops
+    const auto data = compile(source, { .hoist_loop_invariants = false });
+    const auto& root = data.chunk_map.at("__root__");
+    const auto bc = jl::lower(root, {});
+
+    const auto count_op = [&](jl::Op op) {
+        return std::ranges::count_if(bc.code, [&](const jl::Instruction& ins) { return ins.op == op; });
+    };
+
+    // Before fusing every ir except labels lowers to one instruction
+    const auto unfused_size = std::ranges::count_if(root.get_ir(), [](const jl::Ir& ir) {
+        return ir.opcode() != jl::OpCode::LABEL;
+    });
+    const auto unfused_moves = std::ranges::count_if(root.get_ir(), [](const jl::Ir& ir) {
+        return ir.type() == jl::Ir::UNARY && ir.opcode() == jl::OpCode::MOVE
+            && jl::get_type(ir.unary().operand) == jl::OperandType::TEMP;
+    });
+
+    REQUIRE(count_op(jl::Op::JMP_UNLESS_LESS_INT_CONST) == 2);
+    REQUIRE(count_op(jl::Op::JMP_UNLESS) == 0);
+    REQUIRE(count_op(jl::Op::ADD_INT_CONST) == 2);
+    REQUIRE(count_op(jl::Op::LOAD_INDEXED_32) == 2);
+    REQUIRE(count_op(jl::Op::STORE_INDEXED_32) == 1);
+    REQUIRE(count_op(jl::Op::MOVE) < unfused_moves);
+    REQUIRE(bc.code.size() < static_cast<size_t>(unfused_size));
+
+    REQUIRE(data.get<int>("sum") == 216);
+}
+
+TEST_CASE("Function inlining", "[Optimizer]")
+{
+    const auto source = R"(
+        fun square(x: int): int [
+            return x * x;
+        ]
+
+        fun clamp(x: int, limit: int): int [
+            if (x > limit) [
+                return limit;
+            ]
+            x = x + 1;
+            return x;
+        ]
+
+        fun fact(n: int): int [
+            if (n <= 1) [
+                return 1;
+            ]
+            return n * fact(n - 1);
+        ]
+
+        var sum = 0;
+        for (var i = 0; i < 10; i += 1) [
+            sum += clamp(square(i), 50);
+        ]
+        var f = fact(5);
+)";
+
+    const auto plain = compile(source, no_optimizations);
+    const auto inlined = compile(source, { .fold_constants = false, .allocate_registers = false });
+    const auto& root = inlined.chunk_map.at("__root__");
+
+    const auto calls_to = [&](const std::string& name) {
+        return std::ranges::count_if(root.get_ir(), [&](const jl::Ir& ir) {
+            return ir.type() == jl::Ir::CALL && ir.call().func_name == name;
+        });
+    };
+
+    REQUIRE(calls_to("square") == 0);
+    REQUIRE(calls_to("clamp") == 0);
+    REQUIRE(calls_to("fact") == 1);
+
+    REQUIRE(inlined.get<int>("sum") == plain.get<int>("sum"));
+    REQUIRE(inlined.get<int>("sum") == 1 + 2 + 5 + 10 + 17 + 26 + 37 + 50 + 50 + 50);
+    REQUIRE(inlined.get<int>("f") == 120);
+}
+
+TEST_CASE("Inlined locals start cleared", "[Optimizer]")
+{
+    const auto source = R"(
+        fun bump(): int [
+            var seen: int;
+            seen = seen + 1;
+            return seen;
+        ]
+
+        var last = 0;
+        for (var i = 0; i < 3; i += 1) [
+            last = bump();
+        ]
+)";
+
+    const auto plain = compile(source, no_optimizations);
+    const auto inlined = compile(source, {});
+
+    REQUIRE(count_ir(inlined.chunk_map.at("__root__"), jl::Ir::CALL) == 0);
+    REQUIRE(plain.get<int>("last") == 1);
+    REQUIRE(inlined.get<int>("last") == 1);
+}
+
+TEST_CASE("Tail calls reuse the frame", "[Optimizer]")
+{
+    const auto source = R"(
+        fun sum_to(n: int, acc: int): int [
+            if (n == 0) [
+                return acc;
+            ]
+            return sum_to(n - 1, acc + n);
+        ]
+
+        fun gcd(a: int, b: int): int [
+            if (b == 0) [
+                return a;
+            ]
+            return gcd(b, a % b);
+        ]
+
+        fun count(n: int): int [
+            var seen: int;
+            seen = seen + 1;
+            if (n == 0) [
+                return seen;
+            ]
+            return count(n - 1);
+        ]
+
+        var s = sum_to(50000, 0);
+        var g = gcd(1071, 462);
+        var c = count(10);
+)";
+
+    const auto data = compile(source, { .inline_functions = false });
+
+    for (const auto name : { "sum_to", "gcd", "count" }) {
+        REQUIRE(count_ir(data.chunk_map.at(name), jl::Ir::CALL) == 0);
+    }
+
+    REQUIRE(data.get<int>("s") == 1250025000);
+    REQUIRE(data.get<int>("g") == 21);
+    REQUIRE(data.get<int>("c") == 1);
+}
+
+TEST_CASE("Tail calls inside if blocks", "[Optimizer]")
+{
+    const auto source = R"(
+        fun fill(list: [int], i: int, n: int) [
+            if (i < n) [
+                list[i] = i * 2;
+                fill(list, i + 1, n);
+            ]
+        ]
+
+        fun mark(list: [int], n: int) [
+            if (n > 0) [
+                list[n] = n + 10;
+                mark(list, n - 1);
+            ] else [
+                list[0] = 100;
+            ]
+        ]
+
+        var doubled = {0, 0, 0, 0, 0};
+        fill(doubled, 0, 5);
+        var last = doubled[4];
+
+        var marked = {0, 0, 0};
+        mark(marked, 2);
+        var first = marked[0];
+        var second = marked[2];
+)";
+
+    const auto data = compile(source, { .inline_functions = false });
+
+    for (const auto name : { "fill", "mark" }) {
+        REQUIRE(count_ir(data.chunk_map.at(name), jl::Ir::CALL) == 0);
+    }
+
+    REQUIRE(data.get<int>("last") == 8);
+    REQUIRE(data.get<int>("first") == 100);
+    REQUIRE(data.get<int>("second") == 12);
+}
\ No newline at end of file